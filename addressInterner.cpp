@@ -0,0 +1,39 @@
+#include "addressInterner.h"
+
+#include "exceptions.h"
+
+#include <atomic>
+#include <limits>
+
+using namespace std;
+
+AddressInterner::AddressInterner()
+{
+	intern(Address{});
+}
+
+NodeId AddressInterner::intern(Address const& _address)
+{
+	auto [it, inserted] = m_ids.emplace(_address, NodeId(m_addresses.size()));
+	if (inserted)
+	{
+		require(m_addresses.size() < numeric_limits<NodeId>::max());
+		m_addresses.push_back(_address);
+		// Readers on other threads may still use the vector returned by addressStrings.
+		// If they released it, the fence orders their reads before the modification.
+		if (m_addressStrings.use_count() > 1)
+			m_addressStrings = make_shared<vector<string>>(*m_addressStrings);
+		else
+			atomic_thread_fence(memory_order_acquire);
+		m_addressStrings->push_back(to_string(_address));
+	}
+	return it->second;
+}
+
+optional<NodeId> AddressInterner::find(Address const& _address) const
+{
+	auto it = m_ids.find(_address);
+	if (it == m_ids.end())
+		return nullopt;
+	return it->second;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "types.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Assigns dense ids to addresses so that the hot data structures
+/// can be indexed by small integers instead of 20-byte keys.
+/// The zero address always receives the id NullNode.
+class AddressInterner
+{
+public:
+	AddressInterner();
+
+	/// @returns the id of @a _address, assigning a new one if it is not yet known.
+	NodeId intern(Address const& _address);
+	/// @returns the id of @a _address or nullopt if it has not been interned.
+	std::optional<NodeId> find(Address const& _address) const;
+
+	Address const& address(NodeId _id) const { return m_addresses.at(_id); }
+	/// @returns the EIP-55 checksummed hex form of the address with id @a _id.
+	/// It is computed once when the address is interned, so that serialising
+	/// responses does not have to hash the same address again.
+	std::string const& addressString(NodeId _id) const { return m_addressStrings->at(_id); }
+	/// @returns the address strings of all ids interned so far. The returned vector is
+	/// never modified, interning copies it first if it is still shared.
+	std::shared_ptr<std::vector<std::string> const> addressStrings() const { return m_addressStrings; }
+	size_t size() const { return m_addresses.size(); }
+
+private:
+	std::vector<Address> m_addresses;
+	std::shared_ptr<std::vector<std::string>> m_addressStrings = std::make_shared<std::vector<std::string>>();
+	std::unordered_map<Address, NodeId> m_ids;
+};
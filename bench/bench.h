@@ -0,0 +1,30 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/// @returns the time in seconds it takes to run @a _function.
+template <class F>
+double measure(F&& _function)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	_function();
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+}
+
+/// Compares the max-flow engines on a db.dat snapshot.
+int benchFlow(std::vector<std::string> const& _arguments);
+
+/// Compares decoding a db.dat snapshot in place with reading it through a stream.
+int benchDecode(std::vector<std::string> const& _arguments);
+
+/// Compares the limb-wise Int arithmetic with bit-serial reference implementations.
+int benchInt(std::vector<std::string> const& _arguments);
+
+/// Compares the chunked decimal conversion of Int with digit-by-digit versions.
+int benchDecimal(std::vector<std::string> const& _arguments);
+
+/// Compares importing a TheGraph export while parsing it with importing its parsed document.
+int benchImport(std::vector<std::string> const& _arguments);
@@ -0,0 +1,70 @@
+#include "bench/bench.h"
+
+#include "test/intReference.h"
+#include "types.h"
+
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+int benchDecimal(vector<string> const& _arguments)
+{
+	size_t transfers = _arguments.empty() ? 1000 : size_t(stoi(_arguments[0]));
+	size_t responses = _arguments.size() > 1 ? size_t(stoi(_arguments[1])) : 20;
+
+	// Transfer values are mostly amounts of 18-decimal tokens, but cover all widths.
+	mt19937_64 random(42);
+	vector<Int> values(transfers);
+	for (size_t i = 0; i < transfers; ++i)
+	{
+		size_t limbs = i % 10 == 0 ? 4 : i % 3 == 0 ? 1 : 2;
+		for (size_t j = 0; j < limbs; ++j)
+			values[i].data[j] = random();
+		if (limbs == 2)
+			values[i].data[1] %= 1000000;
+	}
+
+	vector<string> expected(transfers);
+	vector<string> actual(transfers);
+	vector<Int> parsed(transfers);
+	double referenceFormatTime = 0;
+	double formatTime = 0;
+	double referenceParseTime = 0;
+	double parseTime = 0;
+	for (size_t round = 0; round < responses; ++round)
+	{
+		referenceFormatTime += measure([&]() {
+			for (size_t i = 0; i < transfers; ++i)
+				expected[i] = referenceFormat(values[i]);
+		});
+		formatTime += measure([&]() {
+			for (size_t i = 0; i < transfers; ++i)
+				actual[i] = to_string(values[i]);
+		});
+		referenceParseTime += measure([&]() {
+			for (size_t i = 0; i < transfers; ++i)
+				parsed[i] = referenceParse(expected[i]);
+		});
+		if (expected != actual || parsed != values)
+		{
+			cout << "Result mismatch." << endl;
+			return 1;
+		}
+		parseTime += measure([&]() {
+			for (size_t i = 0; i < transfers; ++i)
+				parsed[i] = Int(actual[i]);
+		});
+		if (parsed != values)
+		{
+			cout << "Result mismatch." << endl;
+			return 1;
+		}
+	}
+
+	double perResponse = 1000.0 / double(responses);
+	cout << "Per response with " << transfers << " values [ms]    reference    chunked" << endl;
+	cout << "format    " << referenceFormatTime * perResponse << "    " << formatTime * perResponse << endl;
+	cout << "parse     " << referenceParseTime * perResponse << "    " << parseTime * perResponse << endl;
+	return 0;
+}
@@ -0,0 +1,55 @@
+#include "bench/bench.h"
+
+#include "binaryImporter.h"
+#include "mappedFile.h"
+
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <tuple>
+
+using namespace std;
+
+int benchDecode(vector<string> const& _arguments)
+{
+	if (_arguments.empty())
+		return 1;
+	size_t rounds = _arguments.size() > 1 ? size_t(stoi(_arguments[1])) : 5;
+
+	MappedFile file(_arguments[0]);
+	double streamTime = 0;
+	double spanTime = 0;
+	for (size_t i = 0; i < rounds; ++i)
+	{
+		// Keep the results alive so that destroying them is not measured.
+		optional<pair<size_t, DB>> viaStream;
+		optional<pair<size_t, DB>> inPlace;
+		// This is what loadDB used to do with the buffer it is given.
+		streamTime += measure([&]() {
+			string data(file.data(), file.size());
+			istringstream stream(data);
+			viaStream = BinaryImporter(stream).readBlockNumberAndDB();
+		});
+		spanTime += measure([&]() { inPlace = BinaryImporter(file.data(), file.size()).readBlockNumberAndDB(); });
+		auto sameEdge = [](Edge const& _a, Edge const& _b) {
+			return tie(_a.from, _a.to, _a.token, _a.capacity) == tie(_b.from, _b.to, _b.token, _b.capacity);
+		};
+		set<Edge> const& edges = viaStream->second.edges();
+		set<Edge> const& otherEdges = inPlace->second.edges();
+		if (
+			viaStream->first != inPlace->first ||
+			!equal(edges.begin(), edges.end(), otherEdges.begin(), otherEdges.end(), sameEdge)
+		)
+		{
+			cout << "Result mismatch." << endl;
+			return 1;
+		}
+	}
+
+	double megabytes = double(file.size()) * double(rounds) / 1e6;
+	cout << "Decoder    total [s]    throughput [MB/s]" << endl;
+	cout << "stream     " << streamTime << "    " << megabytes / streamTime << endl;
+	cout << "in place   " << spanTime << "    " << megabytes / spanTime << endl;
+	return 0;
+}
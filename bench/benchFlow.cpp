@@ -0,0 +1,91 @@
+#include "bench/bench.h"
+
+#include "binaryImporter.h"
+#include "csrGraph.h"
+#include "maxFlow.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+namespace
+{
+
+struct Engine
+{
+	string name;
+	Int (*run)(CSRGraph const&, vector<Int>&, size_t, size_t, Int);
+	double total = 0;
+	double slowest = 0;
+};
+
+}
+
+int benchFlow(vector<string> const& _arguments)
+{
+	if (_arguments.empty())
+		return 1;
+	size_t pairs = _arguments.size() > 1 ? size_t(stoi(_arguments[1])) : 20;
+	Int limit = _arguments.size() > 2 ? Int(_arguments[2]) : Int::max();
+
+	auto [blockNumber, db] = readDBFile(_arguments[0]);
+	CSRGraph const& graph = db.csrGraph();
+	cout << "Block " << blockNumber << ": " << graph.edgeCount() << " edges, " << graph.nodeCount() << " nodes" << endl;
+
+	// The heaviest queries are the ones towards hubs, so use the nodes
+	// with most incoming edges as sinks and random senders as sources.
+	vector<size_t> inDegree(graph.realNodeCount());
+	vector<NodeId> senders;
+	for (Edge const& edge: db.edges())
+	{
+		inDegree[edge.to]++;
+		if (senders.empty() || senders.back() != edge.from)
+			senders.push_back(edge.from);
+	}
+	vector<NodeId> hubs(graph.realNodeCount());
+	for (size_t i = 0; i < hubs.size(); ++i)
+		hubs[i] = NodeId(i);
+	size_t hubCount = min<size_t>(10, hubs.size());
+	partial_sort(hubs.begin(), hubs.begin() + ptrdiff_t(hubCount), hubs.end(), [&](NodeId _a, NodeId _b) {
+		return inDegree[_a] > inDegree[_b];
+	});
+	if (senders.empty() || hubCount == 0)
+		return 1;
+
+	vector<Engine> engines{
+		{"edmondsKarp", edmondsKarp},
+		{"dinic", dinic},
+		{"pushRelabel", pushRelabel},
+	};
+	mt19937 random(1);
+	for (size_t i = 0; i < pairs; ++i)
+	{
+		NodeId source = senders[random() % senders.size()];
+		NodeId sink = hubs[i % hubCount];
+		optional<Int> expected;
+		cout << db.address(source) << " -> " << db.address(sink) << ":";
+		for (Engine& engine: engines)
+		{
+			vector<Int> residual = graph.capacities();
+			Int flow;
+			double time = measure([&]() { flow = engine.run(graph, residual, source, sink, limit); });
+			engine.total += time;
+			engine.slowest = max(engine.slowest, time);
+			cout << " " << engine.name << " " << time << "s";
+			if (expected && *expected != flow)
+			{
+				cout << endl << "Flow mismatch: " << *expected << " != " << flow << endl;
+				return 1;
+			}
+			expected = flow;
+		}
+		cout << " (flow " << *expected << ")" << endl;
+	}
+
+	cout << endl << "Engine        total [s]    slowest [s]" << endl;
+	for (Engine const& engine: engines)
+		cout << engine.name << string(14 - engine.name.size(), ' ') << engine.total << "    " << engine.slowest << endl;
+	return 0;
+}
@@ -0,0 +1,82 @@
+#include "bench/bench.h"
+
+#include "db.h"
+#include "encoding.h"
+
+#include "json.hpp"
+
+#include <sys/resource.h>
+
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+
+/// @returns the peak resident set size of the process so far in megabytes.
+double peakMegabytes()
+{
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return double(usage.ru_maxrss) / 1024;
+}
+
+/// @returns a checksum of the safes and edges of @a _db, to compare the imports.
+uint64_t summary(DB const& _db)
+{
+	Checksum checksum;
+	auto add = [&](auto const& _value) { checksum.add(reinterpret_cast<char const*>(&_value), sizeof(_value)); };
+	add(_db.safeCount());
+	for (Edge const& edge: _db.edges())
+	{
+		add(edge.from);
+		add(edge.to);
+		add(edge.token);
+		add(edge.capacity.data);
+	}
+	return checksum.value;
+}
+
+}
+
+int benchImport(vector<string> const& _arguments)
+{
+	if (_arguments.empty())
+		return 1;
+
+	// The peak memory can only grow, so the streaming import has to run first.
+	double baseline = peakMegabytes();
+	uint64_t streamedSummary = 0;
+	double streamTime = measure([&]() {
+		ifstream file(_arguments[0]);
+		DB db;
+		db.importFromTheGraph(file);
+		streamedSummary = summary(db);
+	});
+	double streamPeak = peakMegabytes() - baseline;
+
+	uint64_t documentSummary = 0;
+	double documentTime = measure([&]() {
+		// This is what importDB used to do.
+		ifstream file(_arguments[0]);
+		json document;
+		file >> document;
+		DB db;
+		db.importFromTheGraph(document["safes"]);
+		documentSummary = summary(db);
+	});
+	double documentPeak = peakMegabytes() - baseline;
+
+	if (streamedSummary != documentSummary)
+	{
+		cout << "Result mismatch." << endl;
+		return 1;
+	}
+	cout << "Importer   time [s]    peak memory [MB]" << endl;
+	cout << "document   " << documentTime << "    " << documentPeak << endl;
+	cout << "streaming  " << streamTime << "    " << streamPeak << endl;
+	return 0;
+}
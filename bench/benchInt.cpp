@@ -0,0 +1,58 @@
+#include "bench/bench.h"
+
+#include "test/intReference.h"
+#include "types.h"
+
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+int benchInt(vector<string> const& _arguments)
+{
+	size_t count = _arguments.empty() ? 100000 : size_t(stoi(_arguments[0]));
+
+	mt19937_64 random(42);
+	cout << "Width  Operation    reference [ns]    limbs [ns]" << endl;
+	for (size_t limbs: vector<size_t>{1, 2, 4})
+	{
+		// Token amounts are mostly below 2^128, so measure the widths separately.
+		vector<Int> values(count);
+		vector<uint32_t> factors(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			for (size_t j = 0; j < limbs; ++j)
+				values[i].data[j] = random();
+			// Percentages and small divisors are the common case.
+			factors[i] = i % 2 ? uint32_t(random() % 100 + 1) : uint32_t(random() | 1);
+		}
+
+		auto run = [&](string const& _name, auto const& _reference, auto const& _kernel) {
+			vector<Int> expected(count);
+			vector<Int> actual(count);
+			double referenceTime = measure([&]() {
+				for (size_t i = 0; i < count; ++i)
+					expected[i] = _reference(i);
+			});
+			double kernelTime = measure([&]() {
+				for (size_t i = 0; i < count; ++i)
+					actual[i] = _kernel(i);
+			});
+			if (expected != actual)
+			{
+				cout << "Result mismatch in " << _name << "." << endl;
+				return false;
+			}
+			cout << limbs * 64 << "    " << _name << "    " << referenceTime / double(count) * 1e9;
+			cout << "    " << kernelTime / double(count) * 1e9 << endl;
+			return true;
+		};
+		bool ok =
+			run("multiply ", [&](size_t i) { return referenceMultiply(values[i], factors[i]); }, [&](size_t i) { return values[i] * factors[i]; }) &&
+			run("divide   ", [&](size_t i) { return referenceDivide(values[i], factors[i]); }, [&](size_t i) { return values[i] / factors[i]; }) &&
+			run("subtract ", [&](size_t i) { return referenceSubtract(values[i], values[count - 1 - i]); }, [&](size_t i) { return values[i] - values[count - 1 - i]; });
+		if (!ok)
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,27 @@
+#include "bench/bench.h"
+
+#include <functional>
+#include <iostream>
+#include <map>
+
+using namespace std;
+
+int main(int argc, char const** argv)
+{
+	map<string, pair<string, function<int(vector<string> const&)>>> benchmarks{
+		{"decimal", {"[<values> [<responses>]]  Compare formatting and parsing the values of flow responses with digit-by-digit versions.", benchDecimal}},
+		{"decode", {"<db.dat> [<rounds>]  Compare loading a snapshot in place with loading it through a stream.", benchDecode}},
+		{"import", {"<safes.json>  Compare importing the TheGraph export while parsing it with parsing it first.", benchImport}},
+		{"int", {"[<count>]  Compare the Int multiplication, division and subtraction with bit-serial versions.", benchInt}},
+		{"flow", {"<db.dat> [<pairs> [<value>]]  Compare the max-flow engines on hub sinks, optionally stopping at <value>.", benchFlow}},
+	};
+
+	if (argc >= 2 && benchmarks.count(argv[1]))
+		return benchmarks.at(argv[1]).second(vector<string>(argv + 2, argv + argc));
+
+	cerr << "Usage: " << argv[0] << " <benchmark> <arguments>" << endl;
+	cerr << "Benchmarks: " << endl;
+	for (auto const& [name, benchmark]: benchmarks)
+		cerr << "  " << name << " " << benchmark.first << endl;
+	return 1;
+}
@@ -1,27 +1,65 @@
 #include "binaryExporter.h"
 
+#include "dbView.h"
 #include "encoding.h"
 #include "exceptions.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 using namespace std;
 
-BinaryExporter::BinaryExporter(string const& _file):
-	m_file(_file)
+DBFormat dbFormatFromName(string const& _name)
+{
+	if (_name == "v1")
+		return DBFormat::V1;
+	else if (_name == "v1edges")
+		return DBFormat::V1Edges;
+	else if (_name == "v2")
+		return DBFormat::V2;
+	else if (_name == "v3")
+		return DBFormat::V3;
+	else
+		throw InvalidArgumentException();
+}
+
+BinaryExporter::BinaryExporter(string const& _file, bool _append):
+	m_file(_file, _append ? ios::binary | ios::app : ios::binary)
 {
 }
 
-void BinaryExporter::write(size_t _blockNumber, DB const& _db)
+void BinaryExporter::write(size_t _blockNumber, DB const& _db, DBFormat _format)
 {
+	if (_format == DBFormat::V2)
+	{
+		writeV2(_blockNumber, _db);
+		return;
+	}
+	else if (_format == DBFormat::V3)
+	{
+		writeV3(_blockNumber, _db);
+		return;
+	}
+
 	write(_blockNumber);
 	writeAddresses(_db);
 
-	write(_db.safes);
+	write(_db.safeCount());
+	for (NodeId id = 0; id < _db.safes.size(); ++id)
+		if (Safe const* safe = _db.safeMaybe(id))
+		{
+			writeNode(id);
+			write(*safe);
+		}
 	//write(_db.tokens);
+	if (_format == DBFormat::V1Edges && !_db.hasPendingEdgeUpdates())
+		writeEdgesSection(_blockNumber, _db.edges());
 }
 
-void BinaryExporter::write(set<Edge> const& _edges)
+void BinaryExporter::write(set<Edge> const& _edges, AddressInterner const& _addresses)
 {
-	writeAddresses(_edges);
+	writeAddresses(_edges, _addresses);
 
 	cout << "Exporting " << _edges.size() << " edges and " << m_addresses.size() << " unique addresses." << endl;
 	write(_edges.size());
@@ -30,20 +68,131 @@ void BinaryExporter::write(set<Edge> const& _edges)
 }
 
 
+void BinaryExporter::write(DBDiff const& _diff)
+{
+	set<Address> addresses = _diff.removedSafes;
+	for (DBDiff::SafeChange const& change: _diff.changedSafes)
+	{
+		addresses.insert(change.safe);
+		addresses.insert(change.token);
+		for (auto const& balance: change.balances)
+			addresses.insert(balance.first);
+		addresses.insert(change.removedBalances.begin(), change.removedBalances.end());
+		for (auto const& limit: change.limits)
+			addresses.insert(limit.first);
+	}
+	require(m_addresses.empty());
+	m_addresses.assign(addresses.begin(), addresses.end());
+	auto indexOf = [&](Address const& _address) {
+		return size_t(lower_bound(m_addresses.begin(), m_addresses.end(), _address) - m_addresses.begin());
+	};
+	// Writes the addresses in @a _range, which has to be sorted, as differences of their indices.
+	auto writeDeltas = [&](auto const& _range, auto const& _addressOf, auto const& _writeValue) {
+		writeVarint(_range.size());
+		size_t previous = 0;
+		for (auto const& element: _range)
+		{
+			size_t index = indexOf(_addressOf(element));
+			writeVarint(index - previous);
+			previous = index;
+			_writeValue(element);
+		}
+	};
+	auto key = [](auto const& _entry) { return _entry.first; };
+	auto self = [](Address const& _address) { return _address; };
+	auto nothing = [](auto const&) {};
+
+	put(DBDiffMagic, sizeof(DBDiffMagic));
+	put(char(DBDiffVersion));
+	writeVarint(_diff.fromBlock);
+	writeVarint(_diff.toBlock);
+	writeVarint(m_addresses.size());
+	for (auto const& address: m_addresses)
+		put(reinterpret_cast<char const*>(&(address.address[0])), 20);
+
+	writeDeltas(_diff.removedSafes, self, nothing);
+
+	vector<DBDiff::SafeChange const*> changes;
+	for (DBDiff::SafeChange const& change: _diff.changedSafes)
+		changes.push_back(&change);
+	sort(changes.begin(), changes.end(), [](auto const* _a, auto const* _b) { return _a->safe < _b->safe; });
+	writeDeltas(changes, [](auto const* _change) { return _change->safe; }, [&](DBDiff::SafeChange const* _change) {
+		writeVarint(indexOf(_change->token));
+		writeBool(_change->organization);
+		writeDeltas(_change->balances, key, [&](auto const& _balance) { write(_balance.second); });
+		writeDeltas(_change->removedBalances, self, nothing);
+		writeDeltas(_change->limits, key, [&](auto const& _limit) {
+			require(_limit.second <= 100);
+			put(char(_limit.second));
+		});
+	});
+	writeChecksum();
+}
+
+void BinaryExporter::write(JournalEntry const& _entry)
+{
+	// Every record has its own checksum, so that an incomplete last record can be detected.
+	m_checksum = Checksum{};
+	auto writeAddress = [&](Address const& _address) {
+		put(reinterpret_cast<char const*>(&(_address.address[0])), 20);
+	};
+	put(char(_entry.event.index() + 1));
+	writeVarint(_entry.position.blockNumber);
+	writeVarint(_entry.position.logIndex);
+	if (auto const* signup = get_if<SignupEvent>(&_entry.event))
+	{
+		writeAddress(signup->user);
+		writeAddress(signup->token);
+	}
+	else if (auto const* organizationSignup = get_if<OrganizationSignupEvent>(&_entry.event))
+		writeAddress(organizationSignup->organization);
+	else if (auto const* trust = get_if<TrustEvent>(&_entry.event))
+	{
+		require(trust->limitPercentage <= 100);
+		writeAddress(trust->canSendTo);
+		writeAddress(trust->user);
+		put(char(trust->limitPercentage));
+	}
+	else if (auto const* transfer = get_if<TransferEvent>(&_entry.event))
+	{
+		writeAddress(transfer->token);
+		writeAddress(transfer->from);
+		writeAddress(transfer->to);
+		write(transfer->value);
+	}
+	writeChecksum();
+}
+
+void BinaryExporter::write(JournalPositions const& _positions)
+{
+	m_checksum = Checksum{};
+	auto writePosition = [&](JournalPosition const& _position) {
+		writeVarint(_position.blockNumber);
+		writeVarint(_position.logIndex);
+	};
+	writePosition(_positions.hubEvents);
+	writePosition(_positions.transfers);
+	writeVarint(_positions.applied.size());
+	for (JournalPosition const& position: _positions.applied)
+		writePosition(position);
+	writeChecksum();
+}
+
 void BinaryExporter::writeBool(bool _flag)
 {
-	m_file.put(_flag ? 1 : 0);
+	put(_flag ? 1 : 0);
 }
 
 void BinaryExporter::write(size_t const& _size)
 {
 	require(_size < numeric_limits<uint32_t>::max());
-	m_file << BigEndian<4>(_size);
+	for (size_t i = 0; i < 4; ++i)
+		put(char((_size >> ((3 - i) * 8)) & 0xff));
 }
 
-void BinaryExporter::write(Address const& _address)
+void BinaryExporter::writeNode(NodeId _id)
 {
-	write(indexOf(_address));
+	write(indexOf(_id));
 }
 
 void BinaryExporter::write(Int const& _v)
@@ -54,85 +203,305 @@ void BinaryExporter::write(Int const& _v)
 		uint64_t data = (_v.data[i / 8] >> ((i * 8) % 64)) & 0xff;
 		if (!wroteLength && (i == 0 || data != 0))
 		{
-			m_file.put(char(size_t(i + 1)));
+			put(char(size_t(i + 1)));
 			wroteLength = true;
 		}
 		if (wroteLength)
-			m_file.put(char(data));
+			put(char(data));
 	}
 }
 
 void BinaryExporter::write(Safe const& _safe)
 {
-	//write(_safe.address);
-	write(_safe.tokenAddress);
-	write(_safe.balances);
-	write(_safe.limitPercentage);
+	writeNode(_safe.token);
+	write(_safe.balances.size());
+	for (auto const& [token, balance]: _safe.balances)
+	{
+		writeNode(token);
+		write(balance);
+	}
+	write(_safe.limitPercentage.size());
+	for (auto const& [sendTo, percentage]: _safe.limitPercentage)
+	{
+		writeNode(sendTo);
+		write(size_t(percentage));
+	}
 	writeBool(_safe.organization);
 }
 
 void BinaryExporter::write(Token const& _token)
 {
-	write(_token.address);
-	write(_token.safeAddress);
+	writeNode(_token.id);
+	writeNode(_token.safe);
 }
 
 void BinaryExporter::write(Connection const& _connection)
 {
-	write(_connection.canSendToAddress);
-	write(_connection.userAddress);
+	writeNode(_connection.canSendTo);
+	writeNode(_connection.user);
 	write(_connection.limit);
 	write(size_t(_connection.limitPercentage));
 }
 
 void BinaryExporter::write(Edge const& _edge)
 {
-	write(_edge.from);
-	write(_edge.to);
-	write(_edge.token);
+	writeNode(_edge.from);
+	writeNode(_edge.to);
+	writeNode(_edge.token);
 	write(_edge.capacity);
 }
 
-void BinaryExporter::writeAddresses(DB const& _db)
+void BinaryExporter::writeEdgesSection(size_t _blockNumber, set<Edge> const& _edges)
+{
+	put(DBEdgesMagic, sizeof(DBEdgesMagic));
+	write(_blockNumber);
+	write(_edges);
+	writeChecksum();
+}
+
+void BinaryExporter::writeChecksum()
+{
+	uint64_t checksum = m_checksum.value;
+	for (size_t i = 0; i < 8; ++i)
+		put(char((checksum >> ((7 - i) * 8)) & 0xff));
+}
+
+void BinaryExporter::put(char _byte)
 {
-	set<Address> addresses;
-	for (auto const& [safeAddress, safe]: _db.safes)
+	m_checksum.add(_byte);
+	m_file.put(_byte);
+}
+
+void BinaryExporter::put(char const* _data, size_t _length)
+{
+	m_checksum.add(_data, _length);
+	m_file.write(_data, streamsize(_length));
+}
+
+void BinaryExporter::writeV2(size_t _blockNumber, DB const& _db)
+{
+	set<NodeId> ids = referencedNodes(_db);
+	// The zero address comes first so that NullNode keeps its id.
+	ids.insert(NullNode);
+	computeAddressTable(ids, _db.m_addresses);
+
+	vector<DBSafeRecord> safes;
+	vector<DBBalanceRecord> balances;
+	vector<DBLimitRecord> limits;
+	for (NodeId id = 0; id < _db.safes.size(); ++id)
+		if (Safe const* safe = _db.safeMaybe(id))
+		{
+			DBSafeRecord record{};
+			record.id = NodeId(indexOf(id));
+			record.token = NodeId(indexOf(safe->token));
+			record.balancesBegin = uint32_t(balances.size());
+			record.balancesCount = uint32_t(safe->balances.size());
+			record.limitsBegin = uint32_t(limits.size());
+			record.limitsCount = uint32_t(safe->limitPercentage.size());
+			record.organization = safe->organization ? 1 : 0;
+			for (auto const& [token, balance]: safe->balances)
+				balances.push_back(DBBalanceRecord{NodeId(indexOf(token)), 0, balance});
+			for (auto const& [sendTo, percentage]: safe->limitPercentage)
+				limits.push_back(DBLimitRecord{NodeId(indexOf(sendTo)), percentage});
+			// Records are sorted by the node ids of the file, not the ones of the DB.
+			sort(balances.begin() + record.balancesBegin, balances.end(), [](auto const& _a, auto const& _b) { return _a.token < _b.token; });
+			sort(limits.begin() + record.limitsBegin, limits.end(), [](auto const& _a, auto const& _b) { return _a.sendTo < _b.sendTo; });
+			safes.push_back(record);
+		}
+	sort(safes.begin(), safes.end(), [](DBSafeRecord const& _a, DBSafeRecord const& _b) { return _a.id < _b.id; });
+	require(balances.size() < numeric_limits<uint32_t>::max() && limits.size() < numeric_limits<uint32_t>::max());
+
+	vector<DBFileSection> sections{
+		{DBSectionKind::Addresses, sizeof(Address), 0, m_addresses.size()},
+		{DBSectionKind::Safes, sizeof(DBSafeRecord), 0, safes.size()},
+		{DBSectionKind::Balances, sizeof(DBBalanceRecord), 0, balances.size()},
+		{DBSectionKind::Limits, sizeof(DBLimitRecord), 0, limits.size()}
+	};
+
+	// The edges are only written if they are up to date, together with a checksum
+	// over all sections that readers compare before they trust them.
+	vector<Edge> edges;
+	vector<DBEdgesChecksum> checksum;
+	if (!_db.hasPendingEdgeUpdates())
 	{
-		addresses.insert(safeAddress);
-		addresses.insert(safe.tokenAddress);
-		for (auto const& balance: safe.balances)
-			addresses.insert(balance.first);
-		for (auto const& limit: safe.limitPercentage)
-			addresses.insert(limit.first);
+		// Value-initialized, so that the padding is zero.
+		edges.resize(_db.edges().size());
+		auto edge = edges.begin();
+		for (Edge const& e: _db.edges())
+		{
+			edge->from = NodeId(indexOf(e.from));
+			edge->to = NodeId(indexOf(e.to));
+			edge->token = NodeId(indexOf(e.token));
+			edge->capacity = e.capacity;
+			++edge;
+		}
+		sort(edges.begin(), edges.end());
+
+		Checksum contents;
+		auto add = [&](auto const& _records) {
+			contents.add(reinterpret_cast<char const*>(_records.data()), _records.size() * sizeof(_records[0]));
+		};
+		add(m_addresses);
+		add(safes);
+		add(balances);
+		add(limits);
+		add(edges);
+		checksum.push_back(DBEdgesChecksum{_blockNumber, contents.value});
+		sections.push_back({DBSectionKind::Edges, sizeof(Edge), 0, edges.size()});
+		sections.push_back({DBSectionKind::EdgesChecksum, sizeof(DBEdgesChecksum), 0, checksum.size()});
+	}
+	uint64_t offset = sizeof(DBFileHeader) + sections.size() * sizeof(DBFileSection);
+	for (DBFileSection& section: sections)
+	{
+		offset = (offset + 7) / 8 * 8;
+		section.offset = offset;
+		offset += section.count * section.elementSize;
+	}
+
+	DBFileHeader header{};
+	memcpy(header.magic, DBFileMagic, sizeof(header.magic));
+	header.version = DBFileVersion;
+	header.sectionCount = uint32_t(sections.size());
+	header.blockNumber = _blockNumber;
+	m_file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+	writeRecords(sections);
+	writeRecords(m_addresses);
+	writeRecords(safes);
+	writeRecords(balances);
+	writeRecords(limits);
+	if (!checksum.empty())
+	{
+		writeRecords(edges);
+		writeRecords(checksum);
+	}
+}
+
+void BinaryExporter::writeV3(size_t _blockNumber, DB const& _db)
+{
+	set<NodeId> ids = referencedNodes(_db);
+	// The zero address comes first so that NullNode keeps its id.
+	ids.insert(NullNode);
+	computeAddressTable(ids, _db.m_addresses);
+
+	put(DBFileMagic, sizeof(DBFileMagic));
+	put(char(DBCompactFileVersion));
+	writeVarint(_blockNumber);
+	writeVarint(m_addresses.size());
+	for (auto const& address: m_addresses)
+		put(reinterpret_cast<char const*>(&(address.address[0])), 20);
+
+	vector<pair<size_t, Safe const*>> safes;
+	for (NodeId id = 0; id < _db.safes.size(); ++id)
+		if (Safe const* safe = _db.safeMaybe(id))
+			safes.emplace_back(indexOf(id), safe);
+	sort(safes.begin(), safes.end());
+	writeVarint(safes.size());
+	size_t previous = 0;
+	for (auto const& [index, safe]: safes)
+	{
+		writeVarint(index - previous);
+		previous = index;
+		writeVarint(indexOf(safe->token));
+		writeBool(safe->organization);
+		writeDeltas(safe->balances, [&](Int const& _balance) { write(_balance); });
+		writeDeltas(safe->limitPercentage, [&](uint32_t _percentage) {
+			require(_percentage <= 100);
+			put(char(_percentage));
+		});
 	}
-	writeAddresses(addresses);
+
+	if (_db.hasPendingEdgeUpdates())
+		return;
+	vector<Edge> edges;
+	for (Edge const& edge: _db.edges())
+		edges.push_back(Edge{NodeId(indexOf(edge.from)), NodeId(indexOf(edge.to)), NodeId(indexOf(edge.token)), edge.capacity});
+	sort(edges.begin(), edges.end());
+	put(DBEdgesMagic, sizeof(DBEdgesMagic));
+	writeVarint(edges.size());
+	NodeId previousFrom = 0;
+	NodeId previousTo = 0;
+	for (Edge const& edge: edges)
+	{
+		if (edge.from != previousFrom)
+			previousTo = 0;
+		writeVarint(edge.from - previousFrom);
+		writeVarint(edge.to - previousTo);
+		writeVarint(edge.token);
+		write(edge.capacity);
+		previousFrom = edge.from;
+		previousTo = edge.to;
+	}
+	writeChecksum();
 }
 
-void BinaryExporter::writeAddresses(set<Edge> const& _edges)
+void BinaryExporter::writeVarint(uint64_t _value)
 {
-	set<Address> addresses;
+	while (_value >= 0x80)
+	{
+		put(char((_value & 0x7f) | 0x80));
+		_value >>= 7;
+	}
+	put(char(_value));
+}
+
+set<NodeId> BinaryExporter::referencedNodes(DB const& _db)
+{
+	set<NodeId> ids;
+	for (NodeId id = 0; id < _db.safes.size(); ++id)
+		if (Safe const* safe = _db.safeMaybe(id))
+		{
+			ids.insert(id);
+			ids.insert(safe->token);
+			for (auto const& balance: safe->balances)
+				ids.insert(balance.first);
+			for (auto const& limit: safe->limitPercentage)
+				ids.insert(limit.first);
+		}
+	return ids;
+}
+
+void BinaryExporter::writeAddresses(DB const& _db)
+{
+	writeAddresses(referencedNodes(_db), _db.m_addresses);
+}
+
+void BinaryExporter::writeAddresses(set<Edge> const& _edges, AddressInterner const& _addresses)
+{
+	set<NodeId> ids;
 	for (Edge const& edge: _edges)
 	{
-		addresses.insert(edge.from);
-		addresses.insert(edge.to);
-		addresses.insert(edge.token);
+		ids.insert(edge.from);
+		ids.insert(edge.to);
+		ids.insert(edge.token);
 	}
-	writeAddresses(addresses);
+	writeAddresses(ids, _addresses);
 }
 
-void BinaryExporter::writeAddresses(set<Address> const& _addresses)
+void BinaryExporter::writeAddresses(set<NodeId> const& _ids, AddressInterner const& _addresses)
 {
-	require(m_addresses.empty());
-	m_addresses = {_addresses.begin(), _addresses.end()};
+	computeAddressTable(_ids, _addresses);
 
 	write(m_addresses.size());
 	for (auto const& address: m_addresses)
-		m_file.write(reinterpret_cast<char const*>(&(address.address[0])), 20);
+		put(reinterpret_cast<char const*>(&(address.address[0])), 20);
+}
+
+void BinaryExporter::computeAddressTable(set<NodeId> const& _ids, AddressInterner const& _addresses)
+{
+	require(m_addresses.empty());
+	for (NodeId id: _ids)
+		m_addresses.push_back(_addresses.address(id));
+	sort(m_addresses.begin(), m_addresses.end());
+
+	m_indices.assign(_addresses.size(), numeric_limits<size_t>::max());
+	for (NodeId id: _ids)
+		m_indices[id] = size_t(
+			lower_bound(m_addresses.begin(), m_addresses.end(), _addresses.address(id)) - m_addresses.begin()
+		);
 }
 
-size_t BinaryExporter::indexOf(Address const& _address)
+size_t BinaryExporter::indexOf(NodeId _id)
 {
-	auto it = lower_bound(m_addresses.begin(), m_addresses.end(), _address);
-	require(it != m_addresses.end());
-	return size_t(it - m_addresses.begin());
+	require(_id < m_indices.size() && m_indices[_id] != numeric_limits<size_t>::max());
+	return m_indices[_id];
 }
@@ -1,19 +1,54 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
 
 #include "types.h"
 #include "db.h"
+#include "dbDiff.h"
+#include "encoding.h"
+#include "journal.h"
+
+/// Format of db.dat files.
+enum class DBFormat
+{
+	/// Stream of big-endian integers, read by BinaryImporter.
+	V1,
+	/// Version 1 followed by the precomputed edges, see DBEdgesMagic.
+	/// Readers of version 1 ignore the edges, but the file is about twice as large.
+	V1Edges,
+	/// Section table with aligned records that can be used in place, see DBView.
+	V2,
+	/// Varints and delta-coded node ids, the smallest format, see DBCompactFileVersion.
+	V3
+};
+
+/// @returns the format called @a _name ("v1", "v1edges", "v2" or "v3").
+/// Throws InvalidArgumentException for unknown names.
+DBFormat dbFormatFromName(std::string const& _name);
 
 class BinaryExporter
 {
 public:
-	explicit BinaryExporter(std::string const& _file);
+	/// Opens @a _file, replacing its contents unless @a _append is true.
+	explicit BinaryExporter(std::string const& _file, bool _append = false);
 
-	void write(size_t _blockNumber, DB const& _db);
-	void write(std::set<Edge> const& _edges);
+	/// Writes the safes of @a _db and, unless @a _format is V1 or some of its edge updates are
+	/// still delayed, its edges together with a checksum, so that readers do not have to recompute them.
+	void write(size_t _blockNumber, DB const& _db, DBFormat _format = DBFormat::V1);
+	void write(std::set<Edge> const& _edges, AddressInterner const& _addresses);
+	/// Writes @a _diff in the format described at DBDiffMagic.
+	void write(DBDiff const& _diff);
+	/// Appends @a _entry as journal record: the index of its event type in Event plus one (1 byte),
+	/// block number and log index (varints), the event fields (addresses with 20 bytes,
+	/// percentages with 1 byte, amounts as in version 1) and an 8-byte checksum of the record.
+	void write(JournalEntry const& _entry);
+	/// Writes @a _positions as the newest hub event and transfer positions followed by
+	/// the number of applied positions and the positions themselves (all varints) and a checksum.
+	void write(JournalPositions const& _positions);
+	void flush() { m_file.flush(); }
 
 private:
 	template<typename T>
@@ -42,20 +77,68 @@ private:
 	}
 	void writeBool(bool _flag);
 	void write(std::size_t const& _size);
-	void write(Address const& _address);
+	void writeNode(NodeId _id);
 	void write(Int const& _v);
 	void write(Safe const& _safe);
 	void write(Token const& _token);
 	void write(Connection const& _connection);
 	void write(Edge const& _edge);
+	/// Writes the version 1 edges section, see DBEdgesMagic.
+	void writeEdgesSection(size_t _blockNumber, std::set<Edge> const& _edges);
+	/// Writes the checksum of everything written so far.
+	void writeChecksum();
+
+	/// Writes raw bytes and adds them to the checksum.
+	void put(char _byte);
+	void put(char const* _data, size_t _length);
+
+	void writeV2(size_t _blockNumber, DB const& _db);
+	void writeV3(size_t _blockNumber, DB const& _db);
+	/// Writes @a _value as LEB128 varint.
+	void writeVarint(uint64_t _value);
+	/// Writes the size of @a _map and its entries ordered by the file index of their keys.
+	/// Each key is written as the difference to the previous one, followed by its value
+	/// written by @a _writeValue.
+	template <class V, class F>
+	void writeDeltas(std::map<NodeId, V> const& _map, F const& _writeValue)
+	{
+		std::vector<std::pair<size_t, V const*>> entries;
+		for (auto const& [key, value]: _map)
+			entries.emplace_back(indexOf(key), &value);
+		std::sort(entries.begin(), entries.end());
+		writeVarint(entries.size());
+		size_t previous = 0;
+		for (auto const& [index, value]: entries)
+		{
+			writeVarint(index - previous);
+			previous = index;
+			_writeValue(*value);
+		}
+	}
+	/// Writes the elements of @a _records at the next multiple of 8 bytes.
+	template <class T>
+	void writeRecords(std::vector<T> const& _records)
+	{
+		while (m_file.tellp() % 8 != 0)
+			m_file.put(0);
+		m_file.write(reinterpret_cast<char const*>(_records.data()), std::streamsize(_records.size() * sizeof(T)));
+	}
 
+	/// @returns the node ids referenced by the safes of @a _db.
+	static std::set<NodeId> referencedNodes(DB const& _db);
 	void writeAddresses(DB const& _db);
-	void writeAddresses(std::set<Edge> const& _edges);
-	void writeAddresses(std::set<Address> const& _addresses);
-	void writeAddresses();
+	void writeAddresses(std::set<Edge> const& _edges, AddressInterner const& _addresses);
+	void writeAddresses(std::set<NodeId> const& _ids, AddressInterner const& _addresses);
+	/// Fills m_addresses and m_indices without writing anything.
+	void computeAddressTable(std::set<NodeId> const& _ids, AddressInterner const& _addresses);
 
-	size_t indexOf(Address const& _address);
+	size_t indexOf(NodeId _id);
 
 	std::ofstream m_file;
+	/// Checksum of everything written so far in the version 1 format.
+	Checksum m_checksum;
+	/// Sorted address table as written to the file.
 	std::vector<Address> m_addresses;
+	/// Maps node ids to indices into m_addresses.
+	std::vector<size_t> m_indices;
 };
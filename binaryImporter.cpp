@@ -1,34 +1,130 @@
 #include "binaryImporter.h"
 
+#include "dbView.h"
 #include "encoding.h"
 #include "exceptions.h"
+#include "mappedFile.h"
 
+#include <cstring>
+#include <cstdint>
+#include <iterator>
 #include <utility>
 
 using namespace std;
 
+BinaryImporter::BinaryImporter(istream& _input):
+	m_buffer(istreambuf_iterator<char>(_input), istreambuf_iterator<char>()),
+	m_data(m_buffer.data()),
+	m_length(m_buffer.size())
+{
+}
+
 pair<size_t, DB> BinaryImporter::readBlockNumberAndDB()
 {
+	// Version 1 starts with the block number, later versions with a magic value.
+	if (DBView::isDBFile(m_data, m_length))
+		return readDBView();
+	if (m_length > sizeof(DBFileMagic) && memcmp(m_data, DBFileMagic, sizeof(DBFileMagic)) == 0)
+	{
+		require(uint8_t(m_data[sizeof(DBFileMagic)]) == DBCompactFileVersion);
+		return readCompact();
+	}
 	size_t blockNumber = readSize();
-	readAddresses();
 
 	DB db;
+	readAddresses([&](Address const& _address) { return db.intern(_address); });
+
 	size_t numSafes = readSize();
 	for (size_t i = 0; i < numSafes; ++i)
 	{
-		auto const& [address, s] = readSafe();
-		db.tokens[s.tokenAddress].safeAddress = address;
-		db.safes[address] = move(s);
+		auto [id, s] = readSafe();
+		if (s.token != NullNode)
+			db.tokens[s.token] = Token{s.token, id};
+		db.safes[id] = move(s);
 	}
 
-	db.computeEdges();
+	if (optional<set<Edge>> edges = readEdgesSection(blockNumber))
+		db.setEdges(move(*edges));
+	else
+		db.computeEdges();
 
 	return {blockNumber, move(db)};
 }
 
-set<Edge> BinaryImporter::readEdgeSet()
+pair<size_t, DB> BinaryImporter::readDBView()
+{
+	if (reinterpret_cast<uintptr_t>(m_data) % 8 == 0)
+	{
+		DBView view(m_data, m_length);
+		return {view.blockNumber(), view.toDB()};
+	}
+	// Copy into 8-byte aligned memory.
+	vector<uint64_t> buffer((m_length + 7) / 8);
+	memcpy(buffer.data(), m_data, m_length);
+	DBView view(reinterpret_cast<char const*>(buffer.data()), m_length);
+	return {view.blockNumber(), view.toDB()};
+}
+
+pair<size_t, DB> BinaryImporter::readCompact()
 {
-	readAddresses();
+	read(sizeof(DBFileMagic) + 1);
+	size_t blockNumber = readVarint();
+
+	DB db;
+	size_t addressCount = readVarint();
+	require(addressCount <= (m_length - m_position) / 20);
+	m_nodeIds.reserve(addressCount);
+	for (size_t i = 0; i < addressCount; ++i)
+	{
+		Address address;
+		memcpy(address.address.data(), read(20), 20);
+		m_nodeIds.push_back(db.intern(address));
+	}
+
+	// Everything is sorted by address and the addresses are interned in order,
+	// so the maps can be filled from the end.
+	size_t numSafes = readVarint();
+	size_t index = 0;
+	for (size_t i = 0; i < numSafes; ++i)
+	{
+		index += readVarint();
+		NodeId id = nodeId(index);
+		Safe s;
+		s.token = nodeId(readVarint());
+		s.organization = readBool();
+		size_t numBalances = readVarint();
+		size_t token = 0;
+		for (size_t j = 0; j < numBalances; ++j)
+		{
+			token += readVarint();
+			s.balances.emplace_hint(s.balances.end(), nodeId(token), readInt());
+		}
+		size_t numLimits = readVarint();
+		size_t sendTo = 0;
+		for (size_t j = 0; j < numLimits; ++j)
+		{
+			sendTo += readVarint();
+			uint32_t percentage = uint8_t(*read(1));
+			require(percentage <= 100);
+			if (percentage > 0)
+				s.limitPercentage.emplace_hint(s.limitPercentage.end(), nodeId(sendTo), percentage);
+		}
+		if (s.token != NullNode)
+			db.tokens[s.token] = Token{s.token, id};
+		db.safes[id] = move(s);
+	}
+
+	if (optional<set<Edge>> edges = readCompactEdges())
+		db.setEdges(move(*edges));
+	else
+		db.computeEdges();
+
+	return {blockNumber, move(db)};
+}
+
+set<Edge> BinaryImporter::readEdgeSet(AddressInterner& _addresses)
+{
+	readAddresses([&](Address const& _address) { return _addresses.intern(_address); });
 
 	set<Edge> edges;
 
@@ -40,73 +136,220 @@ set<Edge> BinaryImporter::readEdgeSet()
 }
 
 
+DBDiff BinaryImporter::readDBDiff()
+{
+	require(m_length > sizeof(DBDiffMagic) && memcmp(m_data, DBDiffMagic, sizeof(DBDiffMagic)) == 0);
+	require(uint8_t(m_data[sizeof(DBDiffMagic)]) == DBDiffVersion);
+	read(sizeof(DBDiffMagic) + 1);
+
+	DBDiff diff;
+	diff.fromBlock = readVarint();
+	diff.toBlock = readVarint();
+	size_t addressCount = readVarint();
+	require(addressCount <= (m_length - m_position) / 20);
+	vector<Address> addresses(addressCount);
+	for (Address& address: addresses)
+		memcpy(address.address.data(), read(20), 20);
+
+	// Calls @a _readElement with the next address for each of the delta-coded addresses.
+	auto readDeltas = [&](auto const& _readElement) {
+		size_t count = readVarint();
+		size_t index = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			index += readVarint();
+			require(index < addresses.size());
+			_readElement(addresses[index]);
+		}
+	};
+
+	readDeltas([&](Address const& _safe) { diff.removedSafes.insert(diff.removedSafes.end(), _safe); });
+	readDeltas([&](Address const& _safe) {
+		DBDiff::SafeChange change;
+		change.safe = _safe;
+		size_t token = readVarint();
+		require(token < addresses.size());
+		change.token = addresses[token];
+		change.organization = readBool();
+		readDeltas([&](Address const& _token) { change.balances.emplace_hint(change.balances.end(), _token, readInt()); });
+		readDeltas([&](Address const& _token) { change.removedBalances.insert(change.removedBalances.end(), _token); });
+		readDeltas([&](Address const& _sendTo) {
+			uint32_t percentage = uint8_t(*read(1));
+			require(percentage <= 100);
+			change.limits.emplace_hint(change.limits.end(), _sendTo, percentage);
+		});
+		diff.changedSafes.emplace_back(move(change));
+	});
+	require(readChecksum());
+	return diff;
+}
+
+pair<vector<JournalEntry>, size_t> BinaryImporter::readJournal()
+{
+	vector<JournalEntry> entries;
+	size_t validLength = 0;
+	try
+	{
+		while (m_position < m_length)
+		{
+			size_t begin = m_position;
+			JournalEntry entry;
+			uint8_t kind = uint8_t(*read(1));
+			entry.position.blockNumber = readVarint();
+			entry.position.logIndex = readVarint();
+			switch (kind)
+			{
+			case 1:
+				entry.event = SignupEvent{readAddress(), readAddress()};
+				break;
+			case 2:
+				entry.event = OrganizationSignupEvent{readAddress()};
+				break;
+			case 3:
+			{
+				TrustEvent trust{readAddress(), readAddress(), uint8_t(*read(1))};
+				require(trust.limitPercentage <= 100);
+				entry.event = trust;
+				break;
+			}
+			case 4:
+				entry.event = TransferEvent{readAddress(), readAddress(), readAddress(), readInt()};
+				break;
+			default:
+				require(false);
+			}
+			if (!readChecksum(begin))
+				break;
+			entries.emplace_back(move(entry));
+			validLength = m_position;
+		}
+	}
+	catch (Exception const&)
+	{
+	}
+	return {move(entries), validLength};
+}
+
+JournalPositions BinaryImporter::readJournalPositions()
+{
+	auto readPosition = [&]() {
+		JournalPosition position;
+		position.blockNumber = readVarint();
+		position.logIndex = readVarint();
+		return position;
+	};
+	JournalPositions positions;
+	positions.hubEvents = readPosition();
+	positions.transfers = readPosition();
+	size_t count = readVarint();
+	for (size_t i = 0; i < count; i++)
+		positions.applied.insert(positions.applied.end(), readPosition());
+	require(readChecksum());
+	return positions;
+}
+
+char const* BinaryImporter::read(size_t _bytes)
+{
+	require(_bytes <= m_length - m_position);
+	char const* data = m_data + m_position;
+	m_position += _bytes;
+	return data;
+}
+
 bool BinaryImporter::readBool()
 {
-	return m_input.get() != 0;
+	return *read(1) != 0;
 }
 
 size_t BinaryImporter::readSize()
 {
-	uint64_t result{};
-	m_input >> BigEndian<4>(result);
-	return size_t(result);
+	auto const* data = reinterpret_cast<uint8_t const*>(read(4));
+	return (size_t(data[0]) << 24) | (size_t(data[1]) << 16) | (size_t(data[2]) << 8) | size_t(data[3]);
+}
+
+size_t BinaryImporter::readVarint()
+{
+	size_t result = 0;
+	for (size_t shift = 0; ; shift += 7)
+	{
+		require(shift < 64);
+		uint8_t byte = uint8_t(*read(1));
+		result |= size_t(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return result;
+	}
 }
 
 Address BinaryImporter::readAddress()
 {
-	uint64_t index{};
-	m_input >> BigEndian<4>(index);
-	return m_addresses.at(index);
+	Address address;
+	memcpy(address.address.data(), read(20), 20);
+	return address;
+}
+
+NodeId BinaryImporter::readNodeId()
+{
+	return nodeId(readSize());
+}
+
+NodeId BinaryImporter::nodeId(size_t _index) const
+{
+	require(_index < m_nodeIds.size());
+	return m_nodeIds[_index];
 }
 
 Int BinaryImporter::readInt()
 {
-	int bytes = uint8_t(m_input.get());
+	size_t bytes = uint8_t(*read(1));
 	require(bytes <= 32 && bytes > 0);
+	auto const* data = reinterpret_cast<uint8_t const*>(read(bytes));
 	Int v;
-	for (int i = bytes - 1; i >= 0; --i)
-		v.data[i / 8] |= uint64_t(uint8_t(m_input.get())) << ((i * 8) % 64);
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		size_t shift = bytes - 1 - i;
+		v.data[shift / 8] |= uint64_t(data[i]) << ((shift * 8) % 64);
+	}
 	return v;
 }
 
-pair<Address, Safe> BinaryImporter::readSafe()
+pair<NodeId, Safe> BinaryImporter::readSafe()
 {
 	Safe s;
-	Address address = readAddress();
-	s.tokenAddress = readAddress();
+	NodeId id = readNodeId();
+	s.token = readNodeId();
 	size_t numBalances = readSize();
 	for (size_t i = 0; i < numBalances; i++)
 	{
-		Address token = readAddress();
+		NodeId token = readNodeId();
 		Int balance = readInt();
 		s.balances[token] = balance;
 	}
 	size_t numLimits = readSize();
 	for (size_t i = 0; i < numLimits; i++)
 	{
-		Address sendTo = readAddress();
+		NodeId sendTo = readNodeId();
 		uint32_t percentage = readSize();
 		require(percentage <= 100);
 		if (percentage > 0)
 			s.limitPercentage[sendTo] = percentage;
 	}
 	s.organization = readBool();
-	return {address, s};
+	return {id, s};
 }
 
 Token BinaryImporter::readToken()
 {
 	Token t;
-	t.address = readAddress();
-	t.safeAddress = readAddress();
+	t.id = readNodeId();
+	t.safe = readNodeId();
 	return t;
 }
 
 Connection BinaryImporter::readConnection()
 {
 	Connection c;
-	c.canSendToAddress = readAddress();
-	c.userAddress = readAddress();
+	c.canSendTo = readNodeId();
+	c.user = readNodeId();
 	c.limit = readInt();
 	c.limitPercentage = readSize();
 	return c;
@@ -115,19 +358,100 @@ Connection BinaryImporter::readConnection()
 Edge BinaryImporter::readEdge()
 {
 	Edge e;
-	e.from = readAddress();
-	e.to = readAddress();
-	e.token = readAddress();
+	e.from = readNodeId();
+	e.to = readNodeId();
+	e.token = readNodeId();
 	e.capacity = readInt();
 	return e;
 }
 
-void BinaryImporter::readAddresses()
+optional<set<Edge>> BinaryImporter::readEdgesSection(size_t _blockNumber)
+{
+	if (m_length - m_position < sizeof(DBEdgesMagic))
+		return nullopt;
+	if (memcmp(read(sizeof(DBEdgesMagic)), DBEdgesMagic, sizeof(DBEdgesMagic)) != 0)
+		return nullopt;
+
+	set<Edge> edges;
+	try
+	{
+		if (readSize() != _blockNumber)
+			return nullopt;
+		size_t numEdges = readSize();
+		for (size_t i = 0; i < numEdges; ++i)
+			edges.insert(edges.end(), readEdge());
+		if (!readChecksum())
+			return nullopt;
+	}
+	catch (Exception const&)
+	{
+		return nullopt;
+	}
+	return edges;
+}
+
+optional<set<Edge>> BinaryImporter::readCompactEdges()
+{
+	if (m_length - m_position < sizeof(DBEdgesMagic))
+		return nullopt;
+	if (memcmp(read(sizeof(DBEdgesMagic)), DBEdgesMagic, sizeof(DBEdgesMagic)) != 0)
+		return nullopt;
+
+	set<Edge> edges;
+	try
+	{
+		size_t numEdges = readVarint();
+		size_t from = 0;
+		size_t to = 0;
+		for (size_t i = 0; i < numEdges; ++i)
+		{
+			size_t fromDelta = readVarint();
+			if (fromDelta != 0)
+				to = 0;
+			from += fromDelta;
+			to += readVarint();
+			Edge edge{nodeId(from), nodeId(to), nodeId(readVarint()), {}};
+			edge.capacity = readInt();
+			edges.insert(edges.end(), edge);
+		}
+		if (!readChecksum())
+			return nullopt;
+	}
+	catch (Exception const&)
+	{
+		return nullopt;
+	}
+	return edges;
+}
+
+bool BinaryImporter::readChecksum(size_t _begin)
+{
+	Checksum expected;
+	expected.add(m_data + _begin, m_position - _begin);
+	uint64_t checksum = uint64_t(readSize()) << 32;
+	checksum |= uint64_t(readSize());
+	return checksum == expected.value;
+}
+
+void BinaryImporter::readAddresses(function<NodeId(Address const&)> const& _intern)
 {
 	size_t length = readSize();
+	m_nodeIds.reserve(length);
 	for (size_t i = 0; i < length; ++i)
 	{
-		m_addresses.push_back({});
-		m_input.read(reinterpret_cast<char*>(&(m_addresses.back().address[0])), 20);
+		Address address;
+		memcpy(address.address.data(), read(20), 20);
+		m_nodeIds.push_back(_intern(address));
+	}
+}
+
+pair<size_t, DB> readDBFile(string const& _file)
+{
+	MappedFile file(_file);
+	if (DBView::isDBFile(file.data(), file.size()))
+	{
+		DBView view(file.data(), file.size());
+		return {view.blockNumber(), view.toDB()};
 	}
+	return BinaryImporter(file.data(), file.size()).readBlockNumberAndDB();
 }
@@ -2,33 +2,79 @@
 
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <optional>
 #include <utility>
 
 #include "types.h"
 #include "db.h"
+#include "dbDiff.h"
+#include "journal.h"
 
 class BinaryImporter
 {
 public:
-	explicit BinaryImporter(std::istream& _input): m_input(_input) {}
+	/// Decodes @a _data in place, it has to outlive the importer.
+	BinaryImporter(char const* _data, size_t _length): m_data(_data), m_length(_length) {}
+	/// Reads all of @a _input into memory first.
+	explicit BinaryImporter(std::istream& _input);
+	BinaryImporter(BinaryImporter const&) = delete;
+	BinaryImporter& operator=(BinaryImporter const&) = delete;
 
+	/// Reads a db.dat stream in either format. The precomputed edges are used
+	/// if they are present and match the rest of the stream, otherwise the edges are recomputed.
 	std::pair<size_t, DB> readBlockNumberAndDB();
-	std::set<Edge> readEdgeSet();
+	std::set<Edge> readEdgeSet(AddressInterner& _addresses);
+	/// Reads a diff in the format described at DBDiffMagic, throws if its checksum does not match.
+	DBDiff readDBDiff();
+	/// Reads journal records until the end of the data or the first incomplete or corrupt one.
+	/// @returns the entries and the length of the data they were read from.
+	std::pair<std::vector<JournalEntry>, size_t> readJournal();
+	/// Reads positions as written by BinaryExporter::write(JournalPositions const&),
+	/// throws if their checksum does not match.
+	JournalPositions readJournalPositions();
 
 private:
+	/// @returns the next @a _bytes bytes and advances past them, throws at the end of the data.
+	char const* read(size_t _bytes);
 	bool readBool();
 	size_t readSize();
-	Address readAddress();
+	/// Reads a LEB128 varint.
+	size_t readVarint();
+	NodeId readNodeId();
+	/// @returns the node id of the address with index @a _index in the file.
+	NodeId nodeId(size_t _index) const;
 	Int readInt();
-	std::pair<Address, Safe> readSafe();
+	std::pair<NodeId, Safe> readSafe();
 	Token readToken();
 	Connection readConnection();
 	Edge readEdge();
+	/// Reads the version 1 edges section, if present.
+	/// @returns nothing if it is missing or its block number or checksum do not match.
+	std::optional<std::set<Edge>> readEdgesSection(size_t _blockNumber);
+	/// Reads the version 3 edges section, if present.
+	std::optional<std::set<Edge>> readCompactEdges();
+	/// Reads the 8-byte checksum and @returns true if it matches the data
+	/// between @a _begin and the checksum.
+	bool readChecksum(size_t _begin = 0);
+	Address readAddress();
 
-	Address const& address(size_t _index);
+	/// Reads the address table and interns each address using @a _intern.
+	void readAddresses(std::function<NodeId(Address const&)> const& _intern);
 
-	void readAddresses();
+	/// Reads a version 2 file, copying it only if it is not aligned.
+	std::pair<size_t, DB> readDBView();
+	/// Reads a version 3 file.
+	std::pair<size_t, DB> readCompact();
 
-	std::istream& m_input;
-	std::vector<Address> m_addresses;
+	/// Owns the data if it was read from a stream.
+	std::string m_buffer;
+	char const* m_data = nullptr;
+	size_t m_length = 0;
+	size_t m_position = 0;
+	/// Maps address indices in the file to node ids.
+	std::vector<NodeId> m_nodeIds;
 };
+
+/// Reads the db.dat file @a _file in either format. Version 2 files are memory mapped.
+std::pair<size_t, DB> readDBFile(std::string const& _file);
@@ -0,0 +1,113 @@
+#include "csrGraph.h"
+
+#include "exceptions.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+
+struct HalfArc
+{
+	uint32_t tail;
+	uint32_t head;
+	/// Index of the forward arc this belongs to.
+	uint32_t forwardArc;
+	bool forward;
+};
+
+}
+
+CSRGraph::CSRGraph(set<Edge> const& _edges)
+{
+	build(_edges);
+}
+
+CSRGraph::CSRGraph(Span<Edge> _edges)
+{
+	build(_edges);
+}
+
+template <class Edges>
+void CSRGraph::build(Edges const& _edges)
+{
+	m_edgeCount = _edges.size();
+	for (Edge const& edge: _edges)
+	{
+		m_realNodeCount = max(m_realNodeCount, size_t(max(edge.from, edge.to)) + 1);
+		m_pseudoNodes.emplace_back(edge.from, edge.token);
+	}
+	sort(m_pseudoNodes.begin(), m_pseudoNodes.end());
+	m_pseudoNodes.erase(unique(m_pseudoNodes.begin(), m_pseudoNodes.end()), m_pseudoNodes.end());
+	size_t nodes = m_realNodeCount + m_pseudoNodes.size();
+	require(nodes < numeric_limits<uint32_t>::max() / 2);
+
+	auto pseudoNodeIndex = [&](Edge const& _edge) {
+		auto it = lower_bound(m_pseudoNodes.begin(), m_pseudoNodes.end(), make_pair(_edge.from, _edge.token));
+		return uint32_t(m_realNodeCount + size_t(it - m_pseudoNodes.begin()));
+	};
+
+	// Forward arcs: one from each sender to each of its pseudo-nodes with the
+	// maximum over all contributing edges (the balance of the sender), and one
+	// from the pseudo-node to the receiver with the capacity of the edge.
+	vector<HalfArc> halfArcs;
+	vector<Int> forwardCapacities(m_pseudoNodes.size());
+	for (size_t i = 0; i < m_pseudoNodes.size(); ++i)
+		halfArcs.push_back(HalfArc{m_pseudoNodes[i].first, uint32_t(m_realNodeCount + i), uint32_t(i), true});
+	for (Edge const& edge: _edges)
+	{
+		uint32_t pseudoNode = pseudoNodeIndex(edge);
+		Int& senderCapacity = forwardCapacities[pseudoNode - m_realNodeCount];
+		senderCapacity = max(senderCapacity, edge.capacity);
+		halfArcs.push_back(HalfArc{pseudoNode, edge.to, uint32_t(forwardCapacities.size()), true});
+		forwardCapacities.push_back(edge.capacity);
+	}
+	require(forwardCapacities.size() < numeric_limits<uint32_t>::max() / 2);
+	size_t forwardCount = halfArcs.size();
+	for (size_t i = 0; i < forwardCount; ++i)
+		halfArcs.push_back(HalfArc{halfArcs[i].head, halfArcs[i].tail, halfArcs[i].forwardArc, false});
+
+	auto capacityOf = [&](HalfArc const& _arc) -> Int const& {
+		static Int const zero{};
+		return _arc.forward ? forwardCapacities[_arc.forwardArc] : zero;
+	};
+	sort(halfArcs.begin(), halfArcs.end(), [&](HalfArc const& _a, HalfArc const& _b) {
+		if (_a.tail != _b.tail)
+			return _a.tail < _b.tail;
+		Int const& capacityA = capacityOf(_a);
+		Int const& capacityB = capacityOf(_b);
+		if (capacityA != capacityB)
+			return capacityA > capacityB;
+		return tie(_a.head, _a.forward) > tie(_b.head, _b.forward);
+	});
+
+	m_offsets.assign(nodes + 1, 0);
+	m_targets.resize(halfArcs.size());
+	m_reverse.resize(halfArcs.size());
+	m_capacities.resize(halfArcs.size());
+	// Position of the forward (even) and reverse (odd) half of each arc.
+	vector<uint32_t> position(2 * forwardCount);
+	for (size_t i = 0; i < halfArcs.size(); ++i)
+	{
+		HalfArc const& arc = halfArcs[i];
+		m_offsets[arc.tail + 1]++;
+		m_targets[i] = arc.head;
+		m_capacities[i] = capacityOf(arc);
+		position[2 * size_t(arc.forwardArc) + (arc.forward ? 0 : 1)] = uint32_t(i);
+	}
+	for (size_t i = 0; i < nodes; ++i)
+		m_offsets[i + 1] += m_offsets[i];
+	for (size_t i = 0; i < halfArcs.size(); ++i)
+	{
+		HalfArc const& arc = halfArcs[i];
+		m_reverse[i] = position[2 * size_t(arc.forwardArc) + (arc.forward ? 1 : 0)];
+	}
+}
+
+pair<NodeId, NodeId> const& CSRGraph::pseudoNode(size_t _node) const
+{
+	return m_pseudoNodes.at(_node - m_realNodeCount);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "types.h"
+#include "span.h"
+
+#include <set>
+#include <vector>
+
+/// Flow graph in compressed sparse row form, built once from an edge set.
+/// Nodes are the real nodes (indexed by their NodeId) followed by one
+/// pseudo-node per (sender, token) pair, which turns the trust multi-graph
+/// into a simple graph. Every arc is paired with a reverse arc of capacity
+/// zero, so the arrays can directly be used as a residual graph.
+class CSRGraph
+{
+public:
+	explicit CSRGraph(std::set<Edge> const& _edges);
+	/// Builds the graph from sorted and unique edges, e.g. from a mapped snapshot.
+	explicit CSRGraph(Span<Edge> _edges);
+
+	size_t nodeCount() const { return m_offsets.size() - 1; }
+	/// Number of real nodes, they occupy the indices [0, realNodeCount()).
+	size_t realNodeCount() const { return m_realNodeCount; }
+	/// Number of trust edges the graph was built from.
+	size_t edgeCount() const { return m_edgeCount; }
+	size_t arcCount() const { return m_targets.size(); }
+
+	/// The arcs leaving @a _node are [arcsBegin(_node), arcsEnd(_node)),
+	/// sorted by decreasing capacity.
+	size_t arcsBegin(size_t _node) const { return m_offsets[_node]; }
+	size_t arcsEnd(size_t _node) const { return m_offsets[_node + 1]; }
+	size_t target(size_t _arc) const { return m_targets[_arc]; }
+	/// @returns the arc in opposite direction paired with @a _arc.
+	size_t reverse(size_t _arc) const { return m_reverse[_arc]; }
+	/// Original capacities of all arcs, zero for reverse arcs.
+	std::vector<Int> const& capacities() const { return m_capacities; }
+
+	/// @returns the sender and token of the pseudo node with index @a _node.
+	std::pair<NodeId, NodeId> const& pseudoNode(size_t _node) const;
+
+private:
+	template <class Edges>
+	void build(Edges const& _edges);
+
+	size_t m_realNodeCount = 0;
+	size_t m_edgeCount = 0;
+	/// (sender, token) of each pseudo-node.
+	std::vector<std::pair<NodeId, NodeId>> m_pseudoNodes;
+	std::vector<uint32_t> m_offsets;
+	std::vector<uint32_t> m_targets;
+	std::vector<uint32_t> m_reverse;
+	std::vector<Int> m_capacities;
+};
@@ -4,104 +4,157 @@
 
 #include "db.h"
 
+#include "csrGraph.h"
+#include "dbDiff.h"
+#include "parallel.h"
+
 #include "json.hpp"
 
+#include <chrono>
 #include <fstream>
 
 using namespace std;
 using json = nlohmann::json;
 
-Int Safe::balance(Address const& _token) const
+Int Safe::balance(NodeId _token) const
 {
 	auto it = balances.find(_token);
 	return it == balances.end() ? Int{0} : it->second;
 }
 
-uint32_t Safe::sendToPercentage(Address const& _sendTo) const
+uint32_t Safe::sendToPercentage(NodeId _sendTo) const
 {
 	auto it = limitPercentage.find(_sendTo);
 	return it == limitPercentage.end() ? 0 : it->second;
 }
 
-Safe const& DB::safe(Address const& _address) const
+NodeId DB::intern(Address const& _address)
 {
-	auto it = safes.find(_address);
-	require(it != safes.end());
-	return it->second;
+	NodeId id = m_addresses.intern(_address);
+	if (safes.size() < m_addresses.size())
+	{
+		safes.resize(m_addresses.size());
+		tokens.resize(m_addresses.size());
+		m_edgeSenders.resize(m_addresses.size());
+		m_trusters.resize(m_addresses.size());
+		m_holders.resize(m_addresses.size());
+	}
+	return id;
 }
 
-Token const& DB::token(Address const& _address) const
+Safe const& DB::safe(NodeId _id) const
 {
-	auto it = tokens.find(_address);
-	require(it != tokens.end());
-	return it->second;
+	Safe const* s = safeMaybe(_id);
+	require(s);
+	return *s;
 }
 
-Token const* DB::tokenMaybe(Address const& _address) const
+size_t DB::safeCount() const
 {
-	auto it = tokens.find(_address);
-	return it == tokens.end() ? nullptr : &it->second;
+	return size_t(count_if(safes.begin(), safes.end(), [](auto const& _safe) { return bool(_safe); }));
 }
 
-Token* DB::tokenMaybe(Address const& _address)
+Token const& DB::token(NodeId _id) const
 {
-	auto it = tokens.find(_address);
-	return it == tokens.end() ? nullptr : &it->second;
+	Token const* t = tokenMaybe(_id);
+	require(t);
+	return *t;
 }
 
 void DB::importFromTheGraph(json const& _safesJson)
 {
+	m_addresses = AddressInterner{};
 	safes.clear();
 	tokens.clear();
+	m_edgeSenders.clear();
+	m_trusters.clear();
+	m_holders.clear();
 
 	for (json const& safe: _safesJson)
-	{
-		Safe s;
-		s.organization = (safe.contains("organization") && safe["organization"].is_boolean() && safe["organization"]);
-		Address address = Address(string(safe["id"]));
-		for (auto const& balance: safe["balances"])
+		importSafeFromTheGraph(safe);
+	computeEdges();
+}
+
+string DB::importFromTheGraph(istream& _stream)
+{
+	m_addresses = AddressInterner{};
+	safes.clear();
+	tokens.clear();
+	m_edgeSenders.clear();
+	m_trusters.clear();
+	m_holders.clear();
+
+	// Import each safe as soon as it is parsed and discard it afterwards,
+	// so that only the top-level values stay in the parsed document.
+	string topLevelKey;
+	json document = json::parse(_stream, [&](int _depth, json::parse_event_t _event, json& _parsed) {
+		if (_event == json::parse_event_t::key && _depth == 1)
+			topLevelKey = _parsed;
+		else if (_event == json::parse_event_t::object_end && _depth == 2 && topLevelKey == "safes")
 		{
-			Int balanceAmount = Int(string(balance["amount"]));
-			Token t{Address(balance["token"]["id"]), Address(balance["token"]["owner"]["id"])};
-			if (t.safeAddress == address)
-				s.tokenAddress = t.address;
-			tokens.insert({t.address, t});
-			s.balances[t.address] = balanceAmount;
+			importSafeFromTheGraph(_parsed);
+			return false;
 		}
-		safes[address] = move(s);
+		return true;
+	});
+	computeEdges();
+	return document["blockNumber"];
+}
 
-		for (auto const& connections: {safe["outgoing"], safe["incoming"]})
-			for (auto const& connection: connections)
-			{
-				Address sendTo(connection["canSendToAddress"]);
-				Address user(connection["userAddress"]);
-				uint32_t limitPercentage = uint32_t(std::stoi(string(connection["limitPercentage"])));
-				require(limitPercentage <= 100);
-				if (sendTo != Address{} && user != Address{} && sendTo != user && limitPercentage > 0)
-					if (safes.count(user))
-						safes.at(user).limitPercentage[sendTo] = limitPercentage;
-			}
+void DB::importSafeFromTheGraph(json const& _safe)
+{
+	Safe s;
+	s.organization = (_safe.contains("organization") && _safe["organization"].is_boolean() && _safe["organization"]);
+	NodeId id = intern(Address(string(_safe["id"])));
+	for (auto const& balance: _safe["balances"])
+	{
+		Int balanceAmount = Int(string(balance["amount"]));
+		NodeId tokenId = intern(Address(balance["token"]["id"]));
+		NodeId owner = intern(Address(balance["token"]["owner"]["id"]));
+		if (owner == id)
+			s.token = tokenId;
+		if (!tokens[tokenId])
+			tokens[tokenId] = Token{tokenId, owner};
+		s.balances[tokenId] = balanceAmount;
 	}
-	computeEdges();
+	safes[id] = move(s);
+
+	for (auto const& connections: {_safe["outgoing"], _safe["incoming"]})
+		for (auto const& connection: connections)
+		{
+			Address sendTo(connection["canSendToAddress"]);
+			Address user(connection["userAddress"]);
+			uint32_t limitPercentage = uint32_t(std::stoi(string(connection["limitPercentage"])));
+			require(limitPercentage <= 100);
+			if (sendTo != Address{} && user != Address{} && sendTo != user && limitPercentage > 0)
+				if (optional<NodeId> userId = idMaybe(user); userId && safeMaybe(*userId))
+				{
+					NodeId sendToId = intern(sendTo);
+					safes[*userId]->limitPercentage[sendToId] = limitPercentage;
+				}
+		}
 }
 
 json DB::exportToJson() const
 {
 	json result;
-	for (auto const& [address, safe]: safes)
+	for (NodeId id = 0; id < safes.size(); ++id)
 	{
-		json& safeJson = result["safes"][to_string(address)];
+		if (!safes[id])
+			continue;
+		Safe const& safe = *safes[id];
+		json& safeJson = result["safes"][addressString(id)];
 		safeJson["organization"] = safe.organization;
 		for (auto const& [t, balance]: safe.balances)
-			safeJson["balances"][to_string(token(t).safeAddress)] = to_string(balance);
+			safeJson["balances"][addressString(token(t).safe)] = to_string(balance);
 		for (auto const& [sendTo, percentage]: safe.limitPercentage)
-			safeJson["limit"][to_string(sendTo)] = to_string(percentage);
+			safeJson["limit"][addressString(sendTo)] = to_string(percentage);
 	}
 	return result;
 }
 
 
-Int DB::limit(Address const& _user, Address const& _canSendTo) const
+Int DB::limit(NodeId _user, NodeId _canSendTo) const
 {
 	Safe const* senderSafe = safeMaybe(_user);
 	Safe const* receiverSafe = safeMaybe(_canSendTo);
@@ -113,241 +166,466 @@ Int DB::limit(Address const& _user, Address const& _canSendTo) const
 		return {};
 
 	if (receiverSafe->organization)
-		return senderSafe->balance(senderSafe->tokenAddress);
+		return senderSafe->balance(senderSafe->token);
 
-	Token const* receiverToken = tokenMaybe(receiverSafe->tokenAddress);
+	Token const* receiverToken = tokenMaybe(receiverSafe->token);
 	if (!receiverToken)
 		return {};
 
-	Int receiverBalance = receiverSafe->balance(senderSafe->tokenAddress);
+	Int receiverBalance = receiverSafe->balance(senderSafe->token);
 
-	Int amount = (receiverSafe->balance(receiverSafe->tokenAddress) * sendToPercentage) / 100;
+	Int amount = (receiverSafe->balance(receiverSafe->token) * sendToPercentage) / 100;
 	amount = amount < receiverBalance ? Int(0) : amount - receiverBalance;
-	return min(amount, senderSafe->balance(senderSafe->tokenAddress));
+	return min(amount, senderSafe->balance(senderSafe->token));
+}
+
+CSRGraph const& DB::csrGraph() const
+{
+	return *sharedCSRGraph();
+}
+
+shared_ptr<CSRGraph const> DB::sharedCSRGraph() const
+{
+	if (!m_csrGraph)
+		m_csrGraph = make_shared<CSRGraph const>(m_edges);
+	return m_csrGraph;
+}
+
+shared_ptr<DBVersion const> DB::version() const
+{
+	shared_ptr<CSRGraph const> graph = sharedCSRGraph();
+	if (m_version && m_version->graph == graph && m_version->addressStrings->size() == m_addresses.size())
+		return m_version;
+
+	auto version = make_shared<DBVersion>();
+	version->graph = move(graph);
+	version->addressStrings = m_addresses.addressStrings();
+	version->tokenOwners.resize(tokens.size(), NullNode);
+	for (NodeId id = 0; id < tokens.size(); ++id)
+		if (tokens[id])
+			version->tokenOwners[id] = tokens[id]->safe;
+	version->edgeCount = m_edges.size();
+	m_version = move(version);
+	return m_version;
 }
 
 void DB::computeEdges()
 {
-	cerr << "Computing Edges from " << safes.size() << " safes..." << endl;
-	m_edges.clear();
-	m_flowGraph.clear();
-	for (auto const& safe: safes)
-		computeEdgesFrom(safe.first);
+	cerr << "Computing Edges from " << safeCount() << " safes..." << endl;
+	auto t1 = chrono::high_resolution_clock::now();
+	// The edges of different senders are independent, so ranges of senders are processed in parallel.
+	// Since the ranges are contiguous, concatenating the sorted ranges gives all edges in order.
+	vector<vector<Edge>> chunks = parallelChunks(safes.size(), [&](size_t _begin, size_t _end) {
+		vector<Edge> edges;
+		for (NodeId id = NodeId(_begin); id < _end; ++id)
+			collectEdgesFrom(id, edges);
+		// Stable, so that the first of equal edges is kept, like in computeEdgesFrom.
+		stable_sort(edges.begin(), edges.end());
+		return edges;
+	});
+	set<Edge> edges;
+	for (vector<Edge>& chunk: chunks)
+		for (Edge& edge: chunk)
+			edges.emplace_hint(edges.end(), move(edge));
+	setEdges(move(edges));
+	auto t2 = chrono::high_resolution_clock::now();
 	cerr << "Created " << m_edges.size() << " edges..." << endl;
+	cerr << "Took " << chrono::duration_cast<chrono::duration<double>>(t2 - t1).count() << endl;
+}
+
+void DB::setEdges(set<Edge> _edges)
+{
+	m_csrGraph.reset();
+	m_dirtyFrom.clear();
+	m_dirtyTo.clear();
+	m_dirtyTrustEdges.clear();
+	computeIndices();
+	m_edges = move(_edges);
+	for (Edge const& edge: m_edges)
+		m_edgeSenders[edge.to].insert(edge.from);
 }
 
-void DB::computeEdgesFrom(Address const& _user)
+void DB::computeEdgesFrom(NodeId _user)
 {
 	Safe const* safe = safeMaybe(_user);
 	if (!safe)
 		return;
+	m_csrGraph.reset();
 
-	// Edge from user to their own token, restricted by balance.
-	if (safe->tokenAddress != Address{})
-		m_flowGraph[_user][make_pair(_user, safe->tokenAddress)] = safe->balance(safe->tokenAddress);
+	vector<Edge> edges;
+	collectEdgesFrom(_user, edges);
+	for (Edge& edge: edges)
+		addEdge(move(edge));
+}
 
-	// Edges along trust connections.
+void DB::collectEdgesFrom(NodeId _user, vector<Edge>& _edges) const
+{
+	Safe const* safe = safeMaybe(_user);
+	if (!safe)
+		return;
+
+	// Edges along trust connections, restricted by send limit.
 	for (auto const& trust: safe->limitPercentage)
 	{
-		Address const& sendTo = trust.first;
+		NodeId sendTo = trust.first;
 		if (_user == sendTo)
 			continue;
 		Int l = limit(_user, sendTo);
 		if (l == Int(0))
 			continue;
-		m_edges.emplace(Edge{_user, sendTo, safe->tokenAddress, l});
-		// Edge from the user/token pair to the receiver, restricted by send limit.
-		m_flowGraph[make_pair(_user, safe->tokenAddress)][sendTo] = l;
+		_edges.push_back(Edge{_user, sendTo, safe->token, l});
 	}
 
 	// Edges that send tokens back to their owner.
-	for (auto const& [tokenAddress, balance]: safe->balances)
+	for (auto const& [tokenId, balance]: safe->balances)
 		if (balance != Int(0))
-			if (Token const* token = tokenMaybe(tokenAddress))
-				if (_user != token->safeAddress)
-				{
-					m_edges.emplace(Edge{_user, token->safeAddress, tokenAddress, balance});
-					m_flowGraph[_user][make_pair(_user, tokenAddress)] = balance;
-					m_flowGraph[make_pair(_user, tokenAddress)][token->safeAddress] = balance;
-				}
+			if (Token const* token = tokenMaybe(tokenId))
+				if (_user != token->safe)
+					_edges.push_back(Edge{_user, token->safe, tokenId, balance});
 }
 
-void DB::computeEdgesTo(Address const& _sendTo)
+void DB::computeEdgesTo(NodeId _sendTo)
 {
 	Safe const* receiverSafe = safeMaybe(_sendTo);
 	if (!receiverSafe)
 		return;
-	Address const& tokenAddress = receiverSafe->tokenAddress;
+	m_csrGraph.reset();
+	NodeId tokenId = receiverSafe->token;
 
-	for (auto const& [sender, safe]: safes)
+	// Edges along trust connections.
+	for (NodeId sender: m_trusters[_sendTo])
 	{
-		if (sender == _sendTo)
+		Safe const* safe = safeMaybe(sender);
+		if (sender == _sendTo || !safe)
 			continue;
+		Int l = limit(sender, _sendTo);
+		if (l == Int(0))
+			continue;
+		addEdge(Edge{sender, _sendTo, safe->token, l});
+	}
 
-		// Edges along trust connections.
-		if (safe.limitPercentage.count(sender))
+	// Edges that send tokens back to their owner.
+	if (tokenId != NullNode)
+		for (NodeId sender: m_holders[tokenId])
 		{
-			Int l = limit(sender, _sendTo);
-			if (l == Int(0))
+			Safe const* safe = safeMaybe(sender);
+			if (sender == _sendTo || !safe)
 				continue;
-			m_edges.emplace(Edge{sender, _sendTo, safe.tokenAddress, l});
-			m_flowGraph[sender][make_pair(sender, safe.tokenAddress)] = safe.balance(safe.tokenAddress);
-			m_flowGraph[make_pair(sender, safe.tokenAddress)][_sendTo] = l;
-		}
-		// Edges that send tokens back to their owner.
-		Int balance = safe.balance(tokenAddress);
-		if (balance != Int{} && tokenAddress != Address{})
-		{
-			m_edges.emplace(Edge{sender, _sendTo, tokenAddress, balance});
-			m_flowGraph[sender][make_pair(sender, tokenAddress)] = balance;
-			m_flowGraph[make_pair(sender, tokenAddress)][_sendTo] = balance;
+			Int balance = safe->balance(tokenId);
+			if (balance == Int{})
+				continue;
+			addEdge(Edge{sender, _sendTo, tokenId, balance});
 		}
-	}
 }
 
 void DB::signup(Address const& _user, Address const& _token)
 {
-	cerr << "Signup: " << _user << " with token " << _token << endl;
+	if (m_logEvents)
+		cerr << "Signup: " << _user << " with token " << _token << endl;
+	NodeId user = intern(_user);
+	NodeId token = intern(_token);
 	// TODO balances empty at start?
-	if (!safeMaybe(_user))
-		safes[_user] = Safe{_token, {}, {}, false};
-	if (!tokenMaybe(_token))
-		tokens[_token] = Token{_token, _user};
+	if (!safeMaybe(user))
+		safes[user] = Safe{token, {}, {}, false};
+	if (!tokenMaybe(token))
+		tokens[token] = Token{token, user};
 }
 
 void DB::organizationSignup(Address const& _organization)
 {
-	cerr << "Organization signup: " << _organization << endl;
-	if (!safeMaybe(_organization))
-		safes[_organization] = Safe{{}, {}, {}, true};
+	if (m_logEvents)
+		cerr << "Organization signup: " << _organization << endl;
+	NodeId organization = intern(_organization);
+	if (!safeMaybe(organization))
+		safes[organization] = Safe{NullNode, {}, {}, true};
 }
 
 void DB::trust(Address const& _canSendTo, Address const& _user, uint32_t _limitPercentage)
 {
-	cerr << "Trust change: " << _user << " send to " << _canSendTo << ": " << _limitPercentage << "%" << endl;
+	if (m_logEvents)
+		cerr << "Trust change: " << _user << " send to " << _canSendTo << ": " << _limitPercentage << "%" << endl;
 	require(_limitPercentage <= 100);
 
-	if (Safe* safe = safeMaybe(_user))
+	optional<NodeId> user = idMaybe(_user);
+	if (user && safeMaybe(*user))
 	{
+		NodeId canSendTo = intern(_canSendTo);
+		Safe& safe = *safes[*user];
 		if (_limitPercentage == 0)
-			safe->limitPercentage.erase(_canSendTo);
+		{
+			safe.limitPercentage.erase(canSendTo);
+			m_trusters[canSendTo].erase(*user);
+		}
 		else
-			safe->limitPercentage[_canSendTo] = _limitPercentage;
+		{
+			safe.limitPercentage[canSendTo] = _limitPercentage;
+			m_trusters[canSendTo].insert(*user);
+		}
 
-		updateEdgesFrom(_user);
-		// TODO actually only this edge:
-		//updateEdges(_user, _canSendTo, safe->tokenAddress);
+		updateTrustEdge(*user, canSendTo);
 	}
-	else
+	else if (m_logEvents)
 		cerr << "Unknown safe." << endl;
 
-	cerr << "Trust change update complete." << endl;
+	if (m_logEvents)
+		cerr << "Trust change update complete." << endl;
 }
 
-void DB::transfer(
+bool DB::transfer(
 	Address const& _token,
 	Address const& _from,
 	Address const& _to,
 	Int const& _value
 )
 {
-	cerr << "Transfer: " << _value << ": " << _from << " -> " << _to << " [" << _token << "]" << endl;
+	if (m_logEvents)
+		cerr << "Transfer: " << _value << ": " << _from << " -> " << _to << " [" << _token << "]" << endl;
 	// This is a generic ERC20 event and might be unrelated to the
 	// Circles system.
-	Token* token = tokenMaybe(_token);
+	optional<NodeId> tokenId = idMaybe(_token);
+	Token* token = tokenId ? tokenMaybe(*tokenId) : nullptr;
 	if (!token || _value == Int{})
 	{
-		if (!token)
+		if (!token && m_logEvents)
 			cerr << "Token unknown." << endl;
-		return;
+		return false;
 	}
 
+	optional<NodeId> from = idMaybe(_from);
+	optional<NodeId> to = idMaybe(_to);
 	Safe* senderSafe = nullptr;
 	if (_from == Address{})
-		require(_to == token->safeAddress);
+		require(to && *to == token->safe);
 	else
 	{
-		senderSafe = safeMaybe(_from);
+		senderSafe = from ? safeMaybe(*from) : nullptr;
 		if (!senderSafe)
 		{
-			cerr << "Unknown sender safe." << endl;
-			return;
+			if (m_logEvents)
+				cerr << "Unknown sender safe." << endl;
+			return false;
 		}
 		// Regular transfer
-		require(senderSafe->balances[_token] >= _value);
-		senderSafe->balances[_token] -= _value;
+		require(senderSafe->balances[*tokenId] >= _value);
+		senderSafe->balances[*tokenId] -= _value;
 	}
 
-	Safe* receiverSafe = safeMaybe(_to);
+	Safe* receiverSafe = to ? safeMaybe(*to) : nullptr;
 	if (receiverSafe)
-		receiverSafe->balances[_token] += _value;
-	else
+	{
+		receiverSafe->balances[*tokenId] += _value;
+		m_holders[*tokenId].insert(*to);
+	}
+	else if (m_logEvents)
 		cerr << "Unknown receiver safe." << endl;
 
 	if (_from == Address{})
 	{
 		// Token minted.
-		updateEdgesTo(_to);
-		updateEdgesFrom(_to);
+		updateEdgesTo(*to);
+		updateEdgesFrom(*to);
 	}
 	else
 	{
 		// TODO actually only the token
 		// TODO really all of them?
-		updateEdgesFrom(_from);
-		updateEdgesFrom(_to);
-		updateEdgesTo(_from);
-		updateEdgesTo(_to);
+		updateEdgesFrom(*from);
+		if (to)
+			updateEdgesFrom(*to);
+		updateEdgesTo(*from);
+		if (to)
+			updateEdgesTo(*to);
+	}
+	if (m_logEvents)
+		cerr << "Update following transfer complete." << endl;
+	return true;
+}
+
+void DB::applyDiff(DBDiff const& _diff)
+{
+	cerr << "Applying diff of " << _diff.changedSafes.size() << " changed and " << _diff.removedSafes.size() << " removed safes." << endl;
+	bool delayed = m_delayEdgeUpdates;
+	// Collect the touched safes first, so that their edges are only updated once.
+	m_delayEdgeUpdates = true;
+
+	for (Address const& removed: _diff.removedSafes)
+	{
+		optional<NodeId> id = idMaybe(removed);
+		Safe* safe = id ? safeMaybe(*id) : nullptr;
+		if (!safe)
+			continue;
+		for (auto const& [sendTo, percentage]: safe->limitPercentage)
+			m_trusters[sendTo].erase(*id);
+		for (auto const& [token, balance]: safe->balances)
+			m_holders[token].erase(*id);
+		if (Token const* token = tokenMaybe(safe->token); token && token->safe == *id)
+			tokens[safe->token].reset();
+		safes[*id].reset();
+		updateEdgesFrom(*id);
+		updateEdgesTo(*id);
+	}
+
+	for (DBDiff::SafeChange const& change: _diff.changedSafes)
+	{
+		NodeId id = intern(change.safe);
+		NodeId token = intern(change.token);
+		if (!safes[id])
+			safes[id] = Safe{};
+		Safe& safe = *safes[id];
+		if (safe.token != token)
+		{
+			if (Token const* oldToken = tokenMaybe(safe.token); oldToken && oldToken->safe == id)
+				tokens[safe.token].reset();
+			safe.token = token;
+		}
+		if (token != NullNode)
+			tokens[token] = Token{token, id};
+		safe.organization = change.organization;
+
+		for (auto const& [tokenAddress, balance]: change.balances)
+		{
+			NodeId balanceToken = intern(tokenAddress);
+			safe.balances[balanceToken] = balance;
+			m_holders[balanceToken].insert(id);
+		}
+		for (Address const& tokenAddress: change.removedBalances)
+			if (optional<NodeId> balanceToken = idMaybe(tokenAddress))
+			{
+				safe.balances.erase(*balanceToken);
+				m_holders[*balanceToken].erase(id);
+			}
+		for (auto const& [sendToAddress, percentage]: change.limits)
+		{
+			require(percentage <= 100);
+			NodeId sendTo = intern(sendToAddress);
+			if (percentage == 0)
+			{
+				safe.limitPercentage.erase(sendTo);
+				m_trusters[sendTo].erase(id);
+			}
+			else
+			{
+				safe.limitPercentage[sendTo] = percentage;
+				m_trusters[sendTo].insert(id);
+			}
+		}
+		updateEdgesFrom(id);
+		updateEdgesTo(id);
 	}
-	cerr << "Update following transfer complete." << endl;
+
+	if (!delayed)
+		performEdgeUpdates();
 }
 
-void DB::updateEdgesFrom(Address const& _from)
+void DB::updateEdgesFrom(NodeId _from)
 {
 	if (m_delayEdgeUpdates)
+	{
+		m_dirtyFrom.insert(_from);
 		return;
+	}
 
-	cerr << "Updating edges from " << _from << endl;
+	if (m_logEvents)
+		cerr << "Updating edges from " << address(_from) << endl;
+	m_csrGraph.reset();
 
-	// TODO this loop can be optimized because of the sort order.
-	for (auto it = m_edges.begin(); it != m_edges.end();)
-		if (it->from == _from)
-			it = m_edges.erase(it);
-		else
-			++it;
-
-	m_flowGraph.erase(_from);
-	cerr << "erasing pseudo-edges..." <<endl;
-	m_flowGraph.erase(
-		m_flowGraph.lower_bound(make_pair(_from, Address{})),
-		m_flowGraph.upper_bound(make_pair(_from, Address{"0xffffffffffffffffffffffffffffffffffffffff"s}))
-	);
-	cerr << "done" << endl;
+	auto begin = m_edges.lower_bound(Edge{_from, 0, 0, {}});
+	auto end = m_edges.lower_bound(Edge{_from + 1, 0, 0, {}});
+	for (auto it = begin; it != end; ++it)
+		m_edgeSenders[it->to].erase(_from);
+	m_edges.erase(begin, end);
 
 	computeEdgesFrom(_from);
 
-	cerr << "Done." << endl;
+	if (m_logEvents)
+		cerr << "Done." << endl;
 }
 
-void DB::updateEdgesTo(Address const& _to)
+void DB::updateEdgesTo(NodeId _to)
 {
 	if (m_delayEdgeUpdates)
+	{
+		m_dirtyTo.insert(_to);
 		return;
+	}
 
-	cerr << "Updating edges to " << _to << endl;
-	for (auto it = m_edges.begin(); it != m_edges.end();)
-		if (it->to == _to)
-			it = m_edges.erase(it);
-		else
-			++it;
-	cerr << "erasing pseudo-edges..." <<endl;
-	// TODO this does not leave the graph in a clean state, but
-	// it is probably enough.
-	for (auto& [node, targets]: m_flowGraph)
-		targets.erase(_to);
-	cerr << "done" << endl;
+	if (m_logEvents)
+		cerr << "Updating edges to " << address(_to) << endl;
+	m_csrGraph.reset();
+	for (NodeId from: m_edgeSenders[_to])
+		m_edges.erase(
+			m_edges.lower_bound(Edge{from, _to, 0, {}}),
+			m_edges.lower_bound(Edge{from, _to + 1, 0, {}})
+		);
+	m_edgeSenders[_to].clear();
 
 	computeEdgesTo(_to);
 
-	cerr << "Done." << endl;
+	if (m_logEvents)
+		cerr << "Done." << endl;
+}
+
+void DB::updateTrustEdge(NodeId _user, NodeId _canSendTo)
+{
+	if (m_delayEdgeUpdates)
+	{
+		m_dirtyTrustEdges.emplace(_user, _canSendTo);
+		return;
+	}
+
+	Safe const* safe = safeMaybe(_user);
+	if (!safe || _user == _canSendTo)
+		return;
+	m_csrGraph.reset();
+
+	NodeId token = safe->token;
+	m_edges.erase(Edge{_user, _canSendTo, token, {}});
+	Int l = limit(_user, _canSendTo);
+	if (l != Int(0))
+		addEdge(Edge{_user, _canSendTo, token, l});
+	else
+	{
+		// There might still be an edge that sends the receiver's token back.
+		auto next = m_edges.lower_bound(Edge{_user, _canSendTo, 0, {}});
+		if (next == m_edges.end() || next->from != _user || next->to != _canSendTo)
+			m_edgeSenders[_canSendTo].erase(_user);
+	}
+}
+
+void DB::performEdgeUpdates()
+{
+	m_delayEdgeUpdates = false;
+	cerr << "Updating edges of " << m_dirtyFrom.size() << " senders, " << m_dirtyTo.size() << " receivers and ";
+	cerr << m_dirtyTrustEdges.size() << " trust edges..." << endl;
+	// Every edge only depends on the current balances and trust, so the order does not matter.
+	for (NodeId from: m_dirtyFrom)
+		updateEdgesFrom(from);
+	for (NodeId to: m_dirtyTo)
+		updateEdgesTo(to);
+	for (auto const& [user, canSendTo]: m_dirtyTrustEdges)
+		if (!m_dirtyFrom.count(user))
+			updateTrustEdge(user, canSendTo);
+	m_dirtyFrom.clear();
+	m_dirtyTo.clear();
+	m_dirtyTrustEdges.clear();
+}
+
+void DB::computeIndices()
+{
+	for (auto* index: {&m_edgeSenders, &m_trusters, &m_holders})
+		index->assign(m_addresses.size(), {});
+	for (NodeId id = 0; id < safes.size(); ++id)
+		if (safes[id])
+		{
+			for (auto const& [sendTo, percentage]: safes[id]->limitPercentage)
+				m_trusters[sendTo].insert(id);
+			for (auto const& [tokenId, balance]: safes[id]->balances)
+				m_holders[tokenId].insert(id);
+		}
+}
+
+void DB::addEdge(Edge _edge)
+{
+	m_edgeSenders[_edge.to].insert(_edge.from);
+	m_edges.emplace(move(_edge));
 }
@@ -1,82 +1,175 @@
 #pragma once
 
 #include "types.h"
+#include "addressInterner.h"
 #include "json.hpp"
 
+#include <iosfwd>
+#include <memory>
+#include <optional>
+
+class CSRGraph;
+struct DBDiff;
+
 struct Token
 {
-	Address address;
-	Address safeAddress;
+	NodeId id = NullNode;
+	NodeId safe = NullNode;
 
-	bool operator<(Token const& _other) const { return address < _other.address; }
+	bool operator<(Token const& _other) const { return id < _other.id; }
 };
 
 struct Safe
 {
-	Address tokenAddress;
-	/// token address to balance
-	std::map<Address, Int> balances;
+	NodeId token = NullNode;
+	/// token to balance
+	std::map<NodeId, Int> balances;
 	/// Limit percentage in "send to" direction.
-	std::map<Address, uint32_t> limitPercentage;
+	std::map<NodeId, uint32_t> limitPercentage;
 	bool organization{false};
 
-	Int balance(Address const& _token) const;
-	uint32_t sendToPercentage(Address const& _sendToUser) const;
+	Int balance(NodeId _token) const;
+	uint32_t sendToPercentage(NodeId _sendToUser) const;
+};
+
+/// Immutable state of the database that is needed to compute and output a flow.
+/// A new version is created once the edges or addresses changed, and queries can
+/// keep using an older one while the database is updated, see DB::version.
+struct DBVersion
+{
+	std::shared_ptr<CSRGraph const> graph;
+	/// Checksummed address strings by node id.
+	std::shared_ptr<std::vector<std::string> const> addressStrings;
+	/// Safe of each token by node id, NullNode for other nodes.
+	std::vector<NodeId> tokenOwners;
+	size_t edgeCount = 0;
+
+	std::string const& addressString(NodeId _id) const { return addressStrings->at(_id); }
+	NodeId tokenOwner(NodeId _token) const { return tokenOwners.at(_token); }
 };
 
 struct DB
 {
-	std::map<Address, Safe> safes;
-	std::map<Address, Token> tokens;
+	/// Dense ids for all addresses, addresses are only used at the boundaries.
+	AddressInterner m_addresses;
+	/// Safes indexed by node id, empty for ids that are not safes.
+	std::vector<std::optional<Safe>> safes;
+	/// Tokens indexed by node id, empty for ids that are not tokens.
+	std::vector<std::optional<Token>> tokens;
 	/// Trust edges.
 	std::set<Edge> m_edges;
 
-	/// Adjacency list of the flow graph.
-	/// The trust graph is a multi-graph, but this one introduces
-	/// one node on each edge of the trust graph.
-	std::map<FlowGraphNode, std::map<FlowGraphNode, Int>> m_flowGraph;
+	/// Secondary indices by node id, so that updates only touch the neighbourhood
+	/// of a node. They are rebuilt by computeEdges.
+	/// Senders of the edges in m_edges to a node.
+	std::vector<std::set<NodeId>> m_edgeSenders;
+	/// Safes that trust a node, i.e. that have it in their limitPercentage.
+	std::vector<std::set<NodeId>> m_trusters;
+	/// Safes that have a balance entry for a token.
+	std::vector<std::set<NodeId>> m_holders;
 
-	bool m_delayEdgeUpdates = false;
+	/// CSR form of m_edges, built on demand and reset whenever the edges change.
+	mutable std::shared_ptr<CSRGraph const> m_csrGraph;
+	/// The version returned by the last call to version().
+	mutable std::shared_ptr<DBVersion const> m_version;
 
-	Safe const& safe(Address const& _address) const;
-	Safe* safeMaybe(Address const& _address)
+	/// Print lines about each event applied by signup, trust etc. and each edge update.
+	bool m_logEvents = true;
+
+	bool m_delayEdgeUpdates = false;
+	/// Edges to recompute once the delayed edge updates are performed:
+	/// All edges from / to a node and single trust edges.
+	std::set<NodeId> m_dirtyFrom;
+	std::set<NodeId> m_dirtyTo;
+	std::set<std::pair<NodeId, NodeId>> m_dirtyTrustEdges;
+
+	/// @returns the id of @a _address, assigning a new one if needed.
+	NodeId intern(Address const& _address);
+	std::optional<NodeId> idMaybe(Address const& _address) const { return m_addresses.find(_address); }
+	Address const& address(NodeId _id) const { return m_addresses.address(_id); }
+	/// @returns the checksummed hex form of the address of @a _id.
+	std::string const& addressString(NodeId _id) const { return m_addresses.addressString(_id); }
+
+	Safe const& safe(NodeId _id) const;
+	Safe* safeMaybe(NodeId _id)
 	{
-		auto it = safes.find(_address);
-		return it == safes.end() ? nullptr : &it->second;
+		return _id < safes.size() && safes[_id] ? &*safes[_id] : nullptr;
 	}
-	Safe const* safeMaybe(Address const& _address) const
+	Safe const* safeMaybe(NodeId _id) const
 	{
-		auto it = safes.find(_address);
-		return it == safes.end() ? nullptr : &it->second;
+		return _id < safes.size() && safes[_id] ? &*safes[_id] : nullptr;
 	}
+	size_t safeCount() const;
 
-	Token const& token(Address const& _address) const;
-	Token const* tokenMaybe(Address const& _address) const;
-	Token* tokenMaybe(Address const& _address);
+	Token const& token(NodeId _id) const;
+	Token const* tokenMaybe(NodeId _id) const
+	{
+		return _id < tokens.size() && tokens[_id] ? &*tokens[_id] : nullptr;
+	}
+	Token* tokenMaybe(NodeId _id)
+	{
+		return _id < tokens.size() && tokens[_id] ? &*tokens[_id] : nullptr;
+	}
 
-	void importFromTheGraph(nlohmann::json const& _file);
+	/// Replaces the content by the safes in @a _safesJson, the array "safes" of the TheGraph export.
+	void importFromTheGraph(nlohmann::json const& _safesJson);
+	/// Replaces the content by the safes of the TheGraph export read from @a _stream.
+	/// The export is parsed one safe at a time, without keeping the whole document in memory.
+	/// @returns the value of "blockNumber" of the export.
+	std::string importFromTheGraph(std::istream& _stream);
+	/// Adds a single safe of the TheGraph export together with its trust connections to known safes.
+	void importSafeFromTheGraph(nlohmann::json const& _safe);
 	/// Export the database to json - for testing purposes, does not contain all information.
 	nlohmann::json exportToJson() const;
 
 	/// @returns how much of @a _user's token they can send to @a _canSendTo.
-	Int limit(Address const& _user, Address const& _canSendTo) const;
+	Int limit(NodeId _user, NodeId _canSendTo) const;
 
+	/// Recomputes all edges, using one thread per core.
 	void computeEdges();
-	void computeEdgesFrom(Address const& _user);
-	void computeEdgesTo(Address const& _user);
+	/// Replaces the edges by @a _edges, which have to be what computeEdges
+	/// would produce for the current safes, e.g. precomputed edges from a snapshot.
+	void setEdges(std::set<Edge> _edges);
+	void computeEdgesFrom(NodeId _user);
+	/// Appends the edges from @a _user to @a _edges without changing anything.
+	void collectEdgesFrom(NodeId _user, std::vector<Edge>& _edges) const;
+	void computeEdgesTo(NodeId _user);
 	std::set<Edge> const& edges() const { return m_edges; }
-	std::map<FlowGraphNode, std::map<FlowGraphNode, Int>> const& flowGraph() const { return m_flowGraph; }
+	/// @returns the flow graph for the current edges in CSR form.
+	CSRGraph const& csrGraph() const;
+	/// @returns the same graph as csrGraph, which stays valid after the edges change.
+	std::shared_ptr<CSRGraph const> sharedCSRGraph() const;
+	/// @returns the current version, which stays valid and unchanged after the database changes.
+	/// It is only rebuilt if the edges or addresses changed since the last call.
+	std::shared_ptr<DBVersion const> version() const;
 
 	void updateLimit(DB const& _db, Connection& _connection);
 
 	void signup(Address const& _user, Address const& _token);
 	void organizationSignup(Address const& _organization);
 	void trust(Address const& _canSendTo, Address const& _user, uint32_t _limitPercentage);
-	void transfer(Address const& _token, Address const& _from, Address const& _to, Int const& _value);
-
-	void updateEdgesFrom(Address const& _from);
-	void updateEdgesTo(Address const& _to);
+	/// @returns false if the transfer is ignored because it is not a transfer of Circles
+	/// tokens between known safes, e.g. a transfer of some other ERC20 token.
+	bool transfer(Address const& _token, Address const& _from, Address const& _to, Int const& _value);
+	/// Applies the changes of @a _diff and updates the edges of the touched safes,
+	/// unless edge updates are delayed.
+	void applyDiff(DBDiff const& _diff);
+
+	void updateEdgesFrom(NodeId _from);
+	void updateEdgesTo(NodeId _to);
+	/// Recomputes only the trust edge from @a _user to @a _canSendTo.
+	void updateTrustEdge(NodeId _user, NodeId _canSendTo);
+
+	/// Recomputes m_trusters and m_holders from the safes and clears m_edgeSenders.
+	void computeIndices();
+	void addEdge(Edge _edge);
 
 	void delayEdgeUpdates() { m_delayEdgeUpdates = true; }
-	void performEdgeUpdates() { m_delayEdgeUpdates = false; computeEdges(); }
+	/// Recomputes the edges that depend on the safes and tokens touched since delayEdgeUpdates.
+	void performEdgeUpdates();
+	/// @returns true if some edges are outdated because their updates were delayed.
+	bool hasPendingEdgeUpdates() const
+	{
+		return !m_dirtyFrom.empty() || !m_dirtyTo.empty() || !m_dirtyTrustEdges.empty();
+	}
 };
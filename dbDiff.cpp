@@ -0,0 +1,73 @@
+#include "dbDiff.h"
+
+#include "db.h"
+
+using namespace std;
+
+DBDiff computeDiff(DB const& _old, size_t _oldBlock, DB const& _new, size_t _newBlock)
+{
+	DBDiff diff;
+	diff.fromBlock = _oldBlock;
+	diff.toBlock = _newBlock;
+
+	for (NodeId id = 0; id < _new.safes.size(); ++id)
+	{
+		Safe const* safe = _new.safeMaybe(id);
+		if (!safe)
+			continue;
+		optional<NodeId> oldId = _old.idMaybe(_new.address(id));
+		Safe const* oldSafe = oldId ? _old.safeMaybe(*oldId) : nullptr;
+		auto oldNode = [&](NodeId _newNode) { return _old.idMaybe(_new.address(_newNode)); };
+		auto oldBalance = [&](NodeId _token) -> Int const* {
+			optional<NodeId> oldToken = oldNode(_token);
+			if (!oldSafe || !oldToken)
+				return nullptr;
+			auto it = oldSafe->balances.find(*oldToken);
+			return it == oldSafe->balances.end() ? nullptr : &it->second;
+		};
+
+		DBDiff::SafeChange change;
+		change.safe = _new.address(id);
+		change.token = _new.address(safe->token);
+		change.organization = safe->organization;
+		bool changed =
+			!oldSafe ||
+			oldSafe->organization != safe->organization ||
+			_old.address(oldSafe->token) != change.token;
+
+		for (auto const& [token, balance]: safe->balances)
+		{
+			Int const* previous = oldBalance(token);
+			if (!previous || *previous != balance)
+				change.balances[_new.address(token)] = balance;
+		}
+		for (auto const& [sendTo, percentage]: safe->limitPercentage)
+		{
+			optional<NodeId> oldSendTo = oldNode(sendTo);
+			if (!oldSafe || !oldSendTo || oldSafe->sendToPercentage(*oldSendTo) != percentage)
+				change.limits[_new.address(sendTo)] = percentage;
+		}
+		if (oldSafe)
+		{
+			for (auto const& [token, balance]: oldSafe->balances)
+				if (optional<NodeId> newToken = _new.idMaybe(_old.address(token)); !newToken || !safe->balances.count(*newToken))
+					change.removedBalances.insert(_old.address(token));
+			for (auto const& [sendTo, percentage]: oldSafe->limitPercentage)
+				if (optional<NodeId> newSendTo = _new.idMaybe(_old.address(sendTo)); !newSendTo || !safe->limitPercentage.count(*newSendTo))
+					change.limits[_old.address(sendTo)] = 0;
+		}
+
+		if (changed || !change.balances.empty() || !change.removedBalances.empty() || !change.limits.empty())
+			diff.changedSafes.emplace_back(move(change));
+	}
+
+	for (NodeId id = 0; id < _old.safes.size(); ++id)
+		if (_old.safeMaybe(id))
+		{
+			optional<NodeId> newId = _new.idMaybe(_old.address(id));
+			if (!newId || !_new.safeMaybe(*newId))
+				diff.removedSafes.insert(_old.address(id));
+		}
+
+	return diff;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "types.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+struct DB;
+
+/// Changes of the safes between two database snapshots. Everything is stored
+/// by address, so that the diff can be applied to any database that has the
+/// contents of the older snapshot, independent of its node ids.
+struct DBDiff
+{
+	/// New contents of an added or changed safe.
+	struct SafeChange
+	{
+		Address safe;
+		Address token;
+		bool organization = false;
+		/// Added or changed balances by token.
+		std::map<Address, Int> balances;
+		/// Tokens the safe no longer has a balance entry for.
+		std::set<Address> removedBalances;
+		/// Added or changed limit percentages by "send to" address, zero for removed ones.
+		std::map<Address, uint32_t> limits;
+	};
+
+	size_t fromBlock = 0;
+	size_t toBlock = 0;
+	std::vector<SafeChange> changedSafes;
+	std::set<Address> removedSafes;
+};
+
+/// Diff files start with DBDiffMagic and DBDiffVersion, followed by LEB128 varints
+/// in the style of version 3 db.dat files (see DBCompactFileVersion):
+///
+///   from block, to block, address count, addresses (20 bytes each, sorted)
+///   removed safe count, per removed safe: difference to the previous one
+///   changed safe count, per changed safe in order of its address:
+///     difference to the previous safe, token, organization (1 byte),
+///     balance count, per balance: difference to the previous token, balance (as in version 1),
+///     removed balance count, per removed balance: difference to the previous token,
+///     limit count, per limit: difference to the previous "send to" node, percentage (1 byte)
+///   8-byte checksum of everything before it
+char constexpr DBDiffMagic[4] = {'P', 'F', 'D', 'F'};
+uint8_t constexpr DBDiffVersion = 1;
+
+/// @returns the changes from @a _old at block @a _oldBlock to @a _new at block @a _newBlock.
+DBDiff computeDiff(DB const& _old, size_t _oldBlock, DB const& _new, size_t _newBlock);
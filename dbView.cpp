@@ -0,0 +1,151 @@
+#include "dbView.h"
+
+#include "db.h"
+#include "encoding.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+using namespace std;
+
+// The records are used in place, make sure their layout is what the exporter writes.
+static_assert(sizeof(DBFileHeader) == 24);
+static_assert(sizeof(DBFileSection) == 24);
+static_assert(sizeof(Address) == 20 && alignof(Address) == 1);
+static_assert(sizeof(DBSafeRecord) == 28);
+static_assert(sizeof(DBBalanceRecord) == 40 && offsetof(DBBalanceRecord, balance) == 8);
+static_assert(sizeof(DBLimitRecord) == 8);
+static_assert(sizeof(DBEdgesChecksum) == 16);
+static_assert(sizeof(Edge) == 48 && offsetof(Edge, capacity) == 16);
+
+bool DBView::isDBFile(char const* _data, size_t _length)
+{
+	return
+		_length >= sizeof(DBFileHeader) &&
+		memcmp(_data, DBFileMagic, sizeof(DBFileMagic)) == 0 &&
+		reinterpret_cast<DBFileHeader const*>(_data)->version == DBFileVersion;
+}
+
+DBView::DBView(char const* _data, size_t _length):
+	m_data(_data),
+	m_length(_length)
+{
+	require(isDBFile(_data, _length));
+	require(reinterpret_cast<uintptr_t>(_data) % 8 == 0);
+	DBFileHeader const& header = *reinterpret_cast<DBFileHeader const*>(_data);
+	require(header.version == DBFileVersion);
+	require(header.sectionCount <= (_length - sizeof(DBFileHeader)) / sizeof(DBFileSection));
+	m_blockNumber = size_t(header.blockNumber);
+
+	optional<Span<Address>> addresses = section<Address>(DBSectionKind::Addresses);
+	optional<Span<DBSafeRecord>> safes = section<DBSafeRecord>(DBSectionKind::Safes);
+	optional<Span<DBBalanceRecord>> balances = section<DBBalanceRecord>(DBSectionKind::Balances);
+	optional<Span<DBLimitRecord>> limits = section<DBLimitRecord>(DBSectionKind::Limits);
+	require(addresses && safes && balances && limits);
+	m_addresses = *addresses;
+	m_safes = *safes;
+	m_balances = *balances;
+	m_limits = *limits;
+	optional<Span<Edge>> edges = section<Edge>(DBSectionKind::Edges);
+	optional<Span<DBEdgesChecksum>> checksum = section<DBEdgesChecksum>(DBSectionKind::EdgesChecksum);
+	if (edges && checksum && checksum->size() == 1 && (*checksum)[0].blockNumber == m_blockNumber)
+	{
+		Checksum contents;
+		auto add = [&](auto const& _records) {
+			contents.add(reinterpret_cast<char const*>(_records.data()), _records.size() * sizeof(_records[0]));
+		};
+		add(m_addresses);
+		add(m_safes);
+		add(m_balances);
+		add(m_limits);
+		add(*edges);
+		// Otherwise, the edges are recomputed.
+		if (contents.value == (*checksum)[0].checksum)
+		{
+			m_hasEdges = true;
+			m_edges = *edges;
+		}
+	}
+
+	// Validate all references so that the accessors do not need to.
+	require(!m_addresses.empty() && m_addresses[0] == Address{});
+	auto validNode = [&](NodeId _id) { return _id < m_addresses.size(); };
+	for (DBSafeRecord const& safe: m_safes)
+	{
+		require(validNode(safe.id) && validNode(safe.token));
+		require(safe.balancesBegin <= m_balances.size() && safe.balancesCount <= m_balances.size() - safe.balancesBegin);
+		require(safe.limitsBegin <= m_limits.size() && safe.limitsCount <= m_limits.size() - safe.limitsBegin);
+	}
+	for (DBBalanceRecord const& balance: m_balances)
+		require(validNode(balance.token));
+	for (DBLimitRecord const& limit: m_limits)
+		require(validNode(limit.sendTo) && limit.percentage <= 100);
+	for (Edge const& edge: m_edges)
+		require(validNode(edge.from) && validNode(edge.to) && validNode(edge.token));
+}
+
+Span<DBBalanceRecord> DBView::balances(DBSafeRecord const& _safe) const
+{
+	return {m_balances.data() + _safe.balancesBegin, _safe.balancesCount};
+}
+
+Span<DBLimitRecord> DBView::limits(DBSafeRecord const& _safe) const
+{
+	return {m_limits.data() + _safe.limitsBegin, _safe.limitsCount};
+}
+
+optional<NodeId> DBView::find(Address const& _address) const
+{
+	auto it = lower_bound(m_addresses.begin(), m_addresses.end(), _address);
+	if (it == m_addresses.end() || *it != _address)
+		return nullopt;
+	return NodeId(it - m_addresses.begin());
+}
+
+DB DBView::toDB() const
+{
+	DB db;
+	// The address table is sorted and starts with the zero address,
+	// so interning it in order keeps the node ids of the file.
+	for (size_t i = 0; i < m_addresses.size(); ++i)
+		require(db.intern(m_addresses[i]) == i);
+
+	for (DBSafeRecord const& record: m_safes)
+	{
+		Safe safe;
+		safe.token = record.token;
+		safe.organization = record.organization != 0;
+		for (DBBalanceRecord const& balance: balances(record))
+			safe.balances.emplace_hint(safe.balances.end(), balance.token, balance.balance);
+		for (DBLimitRecord const& limit: limits(record))
+			if (limit.percentage > 0)
+				safe.limitPercentage.emplace_hint(safe.limitPercentage.end(), limit.sendTo, limit.percentage);
+		if (safe.token != NullNode)
+			db.tokens[safe.token] = Token{safe.token, record.id};
+		db.safes[record.id] = move(safe);
+	}
+	if (m_hasEdges)
+		db.setEdges(set<Edge>(m_edges.begin(), m_edges.end()));
+	else
+		db.computeEdges();
+	return db;
+}
+
+template <class T>
+optional<Span<T>> DBView::section(DBSectionKind _kind) const
+{
+	auto const* sections = reinterpret_cast<DBFileSection const*>(m_data + sizeof(DBFileHeader));
+	size_t sectionCount = reinterpret_cast<DBFileHeader const*>(m_data)->sectionCount;
+	for (size_t i = 0; i < sectionCount; ++i)
+		if (sections[i].kind == _kind)
+		{
+			DBFileSection const& section = sections[i];
+			require(section.elementSize == sizeof(T));
+			require(section.offset % 8 == 0 && section.offset <= m_length);
+			require(section.count <= (m_length - section.offset) / sizeof(T));
+			return Span<T>{reinterpret_cast<T const*>(m_data + section.offset), size_t(section.count)};
+		}
+	return nullopt;
+}
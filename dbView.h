@@ -0,0 +1,154 @@
+#pragma once
+
+#include "types.h"
+#include "span.h"
+
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+struct DB;
+
+/// Layout of the version 2 db.dat format. Everything is stored in the
+/// native (little-endian) byte order and aligned, so that a mapped file can be
+/// used in place:
+///
+///   DBFileHeader
+///   DBFileSection[sectionCount]
+///   sections, each starting at an offset that is a multiple of 8
+///
+/// Node ids in the file are indices into the sorted address table,
+/// which always starts with the zero address, so that NullNode keeps its meaning.
+///
+/// Version 1 files start with the block number as a 4-byte big-endian
+/// integer instead, which is how the two are told apart. They can end with
+/// an edges section: DBEdgesMagic, the block number, the edges and an 8-byte
+/// checksum of everything before it.
+struct DBFileHeader
+{
+	char magic[4];
+	uint8_t version;
+	uint8_t reserved[3];
+	uint32_t sectionCount;
+	uint32_t reserved2;
+	uint64_t blockNumber;
+};
+
+enum class DBSectionKind: uint32_t
+{
+	/// Address[]
+	Addresses = 1,
+	/// DBSafeRecord[], sorted by id
+	Safes = 2,
+	/// DBBalanceRecord[], referenced by the safes
+	Balances = 3,
+	/// DBLimitRecord[], referenced by the safes
+	Limits = 4,
+	/// Edge[], the result of DB::computeEdges, sorted
+	Edges = 5,
+	/// DBEdgesChecksum[1], only present together with the edges
+	EdgesChecksum = 6
+};
+
+struct DBFileSection
+{
+	DBSectionKind kind;
+	uint32_t elementSize;
+	uint64_t offset;
+	uint64_t count;
+};
+
+struct DBSafeRecord
+{
+	NodeId id;
+	NodeId token;
+	uint32_t balancesBegin;
+	uint32_t balancesCount;
+	uint32_t limitsBegin;
+	uint32_t limitsCount;
+	uint32_t organization;
+};
+
+struct DBBalanceRecord
+{
+	NodeId token;
+	uint32_t reserved;
+	Int balance;
+};
+
+struct DBLimitRecord
+{
+	NodeId sendTo;
+	uint32_t percentage;
+};
+
+/// Checksum of the contents of the other sections, the edges are only used if it matches.
+struct DBEdgesChecksum
+{
+	uint64_t blockNumber;
+	uint64_t checksum;
+};
+
+char constexpr DBFileMagic[4] = {'P', 'F', 'D', 'B'};
+uint8_t constexpr DBFileVersion = 2;
+/// Start of the edges section at the end of version 1 files.
+char constexpr DBEdgesMagic[4] = {'P', 'F', 'E', 'D'};
+
+/// Version 3 files are a compact stream that starts with DBFileMagic and
+/// this version byte, followed by LEB128 varints:
+///
+///   block number, address count, addresses (20 bytes each, sorted, starting with the zero address)
+///   safe count, per safe in order of its address:
+///     difference to the previous safe, token, organization (1 byte),
+///     balance count, per balance: difference to the previous token, balance (as in version 1),
+///     limit count, per limit: difference to the previous "send to" node, percentage (1 byte)
+///   optionally DBEdgesMagic, edge count, per edge in sorted order:
+///     difference to the previous sender, receiver (difference to the previous one if
+///     the sender did not change), token, capacity, followed by the 8-byte checksum of everything before it.
+///
+/// Readers of version 2 reject these files because of the version byte.
+uint8_t constexpr DBCompactFileVersion = 3;
+
+/// Read-only view of a version 2 db.dat file that is used in place, without parsing.
+/// The data has to be aligned to 8 bytes and has to outlive the view.
+class DBView
+{
+public:
+	/// @returns true if @a _data starts with the version 2 header.
+	static bool isDBFile(char const* _data, size_t _length);
+
+	/// Validates the header and the section bounds, throws if they are invalid.
+	DBView(char const* _data, size_t _length);
+
+	size_t blockNumber() const { return m_blockNumber; }
+
+	Span<Address> addresses() const { return m_addresses; }
+	Span<DBSafeRecord> safes() const { return m_safes; }
+	Span<DBBalanceRecord> balances(DBSafeRecord const& _safe) const;
+	Span<DBLimitRecord> limits(DBSafeRecord const& _safe) const;
+	/// @returns false if the file does not contain precomputed edges
+	/// or if they do not match the rest of the file.
+	bool hasEdges() const { return m_hasEdges; }
+	Span<Edge> edges() const { return m_edges; }
+
+	/// @returns the node id of @a _address, using binary search in the address table.
+	std::optional<NodeId> find(Address const& _address) const;
+	Address const& address(NodeId _id) const { return m_addresses[_id]; }
+
+	/// Builds a mutable database, re-using the precomputed edges if present.
+	DB toDB() const;
+
+private:
+	template <class T>
+	std::optional<Span<T>> section(DBSectionKind _kind) const;
+
+	char const* m_data = nullptr;
+	size_t m_length = 0;
+	size_t m_blockNumber = 0;
+	Span<Address> m_addresses;
+	Span<DBSafeRecord> m_safes;
+	Span<DBBalanceRecord> m_balances;
+	Span<DBLimitRecord> m_limits;
+	bool m_hasEdges = false;
+	Span<Edge> m_edges;
+};
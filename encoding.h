@@ -4,6 +4,8 @@
 
 #include <variant>
 #include <iostream>
+#include <cstdint>
+#include <cstddef>
 
 
 template <size_t _bytes>
@@ -30,6 +32,23 @@ struct BigEndian
 	}
 };
 
+/// 64-bit FNV-1a hash, used to check that the precomputed edges of a db.dat
+/// file belong to the rest of the file.
+struct Checksum
+{
+	uint64_t value = 0xcbf29ce484222325;
+
+	void add(char _byte)
+	{
+		value = (value ^ uint8_t(_byte)) * 0x100000001b3;
+	}
+	void add(char const* _data, size_t _length)
+	{
+		for (size_t i = 0; i < _length; ++i)
+			add(_data[i]);
+	}
+};
+
 inline uint8_t fromHex(char _c)
 {
 	if ('0' <= _c && _c <= '9')
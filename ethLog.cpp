@@ -0,0 +1,119 @@
+#include "ethLog.h"
+
+#include "encoding.h"
+#include "exceptions.h"
+#include "keccak.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+
+/// @returns the topic of the event with the given signature as lowercase hex string.
+string eventTopic(string const& _signature)
+{
+	string topic = "0x";
+	for (char c: keccak256(_signature))
+	{
+		topic.push_back(toHex(uint8_t(c) >> 4));
+		topic.push_back(toHex(uint8_t(c) & 0xf));
+	}
+	return topic;
+}
+
+string const signupTopic = eventTopic("Signup(address,address)");
+string const organizationSignupTopic = eventTopic("OrganizationSignup(address)");
+string const trustTopic = eventTopic("Trust(address,address,uint256)");
+string const transferTopic = eventTopic("Transfer(address,address,uint256)");
+
+string lowercase(string _value)
+{
+	for (char& c: _value)
+		c = char(tolower(c));
+	return _value;
+}
+
+bool isWord(string const& _word)
+{
+	return _word.size() == 2 + 64 && _word[0] == '0' && _word[1] == 'x';
+}
+
+bool isAddressWord(string const& _word)
+{
+	return isWord(_word) && _word.compare(0, 2 + 24, "0x" + string(24, '0')) == 0;
+}
+
+/// @returns the 32 byte ABI-encoded word @a _word as Int.
+Int word(string const& _word)
+{
+	require(isWord(_word));
+	return Int(_word);
+}
+
+/// @returns the address ABI-encoded in the 32 byte word @a _word.
+Address addressWord(string const& _word)
+{
+	require(isAddressWord(_word));
+	return Address("0x" + _word.substr(2 + 24));
+}
+
+size_t quantity(json const& _value)
+{
+	if (_value.is_number())
+		return size_t(_value);
+	string value = _value;
+	if (value.size() > 2 && value[0] == '0' && value[1] == 'x')
+		return size_t(stoull(value.substr(2), nullptr, 16));
+	return size_t(stoull(value));
+}
+
+}
+
+optional<JournalEntry> decodeLog(json const& _log, optional<Address> const& _hub)
+{
+	if (_log.contains("removed") && _log["removed"] == true)
+		return nullopt;
+	json const& topics = _log["topics"];
+	if (topics.empty())
+		return nullopt;
+	string topic = lowercase(topics[0]);
+	Address emitter{string(_log["address"])};
+	string data = _log.contains("data") ? string(_log["data"]) : "0x";
+
+	optional<Event> event;
+	if (topic == transferTopic)
+	{
+		// Any contract can emit this event, so malformed ones are ignored instead of rejected.
+		// ERC721 transfers have the same signature, but the token id is indexed.
+		if (topics.size() != 3 || !isAddressWord(topics[1]) || !isAddressWord(topics[2]) || !isWord(data))
+			return nullopt;
+		event = TransferEvent{emitter, addressWord(topics[1]), addressWord(topics[2]), word(data)};
+	}
+	else if (topic == signupTopic || topic == organizationSignupTopic || topic == trustTopic)
+	{
+		if (_hub && emitter != *_hub)
+			return nullopt;
+		if (topic == signupTopic)
+		{
+			require(topics.size() == 2);
+			event = SignupEvent{addressWord(topics[1]), addressWord(data)};
+		}
+		else if (topic == organizationSignupTopic)
+		{
+			require(topics.size() == 2);
+			event = OrganizationSignupEvent{addressWord(topics[1])};
+		}
+		else
+		{
+			require(topics.size() == 3);
+			Int limitPercentage = word(data);
+			require(limitPercentage <= Int(100));
+			event = TrustEvent{addressWord(topics[1]), addressWord(topics[2]), uint32_t(limitPercentage.data[0])};
+		}
+	}
+	else
+		return nullopt;
+
+	return JournalEntry{JournalPosition{quantity(_log["blockNumber"]), quantity(_log["logIndex"])}, move(*event)};
+}
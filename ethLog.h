@@ -0,0 +1,15 @@
+#pragma once
+
+#include "journal.h"
+#include "json.hpp"
+
+#include <optional>
+
+/// Decodes an entry of the result of eth_getLogs, i.e. an object with "address", "topics",
+/// "data", "blockNumber" and "logIndex", where the numbers can be hex strings or numbers.
+/// Signup, OrganizationSignup and Trust events are decoded as hub events, which are
+/// ignored if @a _hub is given and the log was emitted by a different contract.
+/// ERC20 Transfer events of all contracts are decoded as transfers of the emitting token.
+/// @returns nothing for other, removed and malformed transfer logs.
+/// Throws if a hub event is malformed.
+std::optional<JournalEntry> decodeLog(nlohmann::json const& _log, std::optional<Address> const& _hub = std::nullopt);
@@ -1,435 +1,360 @@
 #include "flow.h"
 
-#include "adjacencies.h"
+#include "csrGraph.h"
+#include "maxFlow.h"
+#include "exceptions.h"
 
 #include <queue>
 #include <iostream>
 #include <variant>
 #include <functional>
 #include <algorithm>
-#include <cassert>
 #include <chrono>
+#include <optional>
+#include <limits>
 
 using namespace std;
 
-using Node = FlowGraphNode;
-
-Node pseudoNode(Edge const& _edge)
+FlowEngine flowEngineFromName(string const& _name)
 {
-	return make_tuple(_edge.from, _edge.token);
+	if (_name == "edmondsKarp")
+		return FlowEngine::EdmondsKarp;
+	else if (_name == "dinic")
+		return FlowEngine::Dinic;
+	else if (_name == "pushRelabel")
+		return FlowEngine::PushRelabel;
+	else
+		throw InvalidArgumentException();
 }
 
-/// Concatenate the contents of a container onto a vector, move variant.
-template <class T, class U> vector<T>& operator+=(vector<T>& _a, U&& _b)
+/// Decomposes the acyclic flow given by the residual capacities into transfers.
+/// The senders are processed in topological order, so each of them has
+/// received all of its incoming transfers before it sends anything and
+/// no balance is ever overdrawn.
+vector<Edge> extractTransfers(CSRGraph const& _graph, vector<Int> const& _residual, NodeId _source)
 {
-	std::move(_b.begin(), _b.end(), std::back_inserter(_a));
-	return _a;
-}
+	auto hasFlow = [&](size_t _arc) { return _residual[_arc] < _graph.capacities()[_arc]; };
 
-template <class K, class V, class F>
-void erase_if(map<K, V>& _container, F const& _fun)
-{
-	for (auto it = _container.begin(); it != _container.end();)
-		 if (_fun(*it))
-			it = _container.erase(it);
-		 else
-			++it;
-}
+	// Number of incoming transfers of each real node.
+	vector<size_t> incoming(_graph.realNodeCount());
+	for (size_t node = _graph.realNodeCount(); node < _graph.nodeCount(); ++node)
+		for (size_t arc = _graph.arcsBegin(node); arc != _graph.arcsEnd(node); ++arc)
+			if (hasFlow(arc))
+				incoming[_graph.target(arc)]++;
 
-/// Turns the edge set into an adjacency list.
-/// At the same time, it generates new pseudo-nodes to cope with the multi-edges.
-map<Node, map<Node, Int>> computeAdjacencies(set<Edge> const& _edges)
-{
-	//Int const minCap("1000000000000000");
-	map<Node, map<Node, Int>> adjacencies;
-	for (Edge const& edge: _edges)
-	{
-		//if (edge.capacity < minCap)
-		//	continue;
-		// One edge from "from" to "from x token" with a capacity as the max over
-		// all contributing edges (the balance of the sender)
-		adjacencies[edge.from][pseudoNode(edge)] = max(edge.capacity, adjacencies[edge.from][pseudoNode(edge)]);
-		// Another edge from "from x token" to "to" with its own capacity (based on the trust)
-		adjacencies[pseudoNode(edge)][edge.to] = edge.capacity;
-	}
-	return adjacencies;
-}
-
-vector<pair<Node, Int>> sortedByCapacity(map<Node, Int> const& _capacities)
-{
-	vector<pair<Node, Int>> r(_capacities.begin(), _capacities.end());
-	sort(r.begin(), r.end(), [](pair<Node, Int> const& _a, pair<Node, Int> const& _b) {
-		return tie(get<1>(_a), get<0>(_a)) > tie(get<1>(_b), get<0>(_b));
-	});
-	return r;
-}
-
-pair<Int, map<Node, Node>> augmentingPath(
-	Address const& _source,
-	Address const& _sink,
-	Adjacencies& _adjacencies
-)
-{
-	if (_source == _sink)
-		return {Int(0), {}};
-
-	map<Node, Node> parent;
-	queue<pair<Node, Int>> q;
-	q.emplace(_source, Int::max());
-
-	while (!q.empty())
-	{
-		//cout << "Queue size: " << q.size() << endl;
-		//cout << "Parent relation size: " << parent.size() << endl;
-		auto [node, flow] = q.front();
-		q.pop();
-		for (auto const& [target, capacity]: _adjacencies.outgoingEdgesSortedByCapacity(node))
-			if (!parent.count(target) && Int(0) < capacity)
-			{
-				parent[target] = node;
-				Int newFlow = min(flow, capacity);
-				if (target == Node{_sink})
-					return make_pair(move(newFlow), move(parent));
-				q.emplace(target, move(newFlow));
-			}
-	}
-	return {Int(0), {}};
-}
-
-/// Extract the next list of transfers until we get to a situation where
-/// we cannot transfer the full balance and start over.
-vector<Edge> extractNextTransfers(map<Node, map<Node, Int>>& _usedEdges, map<Address, Int>& _nodeBalances)
-{
 	vector<Edge> transfers;
-
-	for (auto& [node, balance]: _nodeBalances)
-		for (auto& edge: _usedEdges[node])
+	vector<size_t> queue{_source};
+	for (size_t head = 0; head < queue.size(); ++head)
+	{
+		size_t from = queue[head];
+		for (size_t arc = _graph.arcsBegin(from); arc != _graph.arcsEnd(from); ++arc)
 		{
-			Node const& intermediate = edge.first;
-			for (auto& [toNode, capacity]: _usedEdges[intermediate])
+			if (!hasFlow(arc))
+				continue;
+			size_t intermediate = _graph.target(arc);
+			NodeId token = _graph.pseudoNode(intermediate).second;
+			for (size_t next = _graph.arcsBegin(intermediate); next != _graph.arcsEnd(intermediate); ++next)
 			{
-				auto const& [from, token] = std::get<tuple<Address, Address>>(intermediate);
-				Address to = std::get<Address>(toNode);
-				if (capacity == Int(0))
+				if (!hasFlow(next))
 					continue;
-				if (balance < capacity)
-				{
-					// We do not have enough balance yet, there will be another transfer along this edge.
-					if (!transfers.empty())
-						return transfers;
-					else
-						continue;
-				}
-				transfers.push_back(Edge{from, to, token, capacity});
-				balance -= capacity;
-				_nodeBalances[to] += capacity;
-				capacity = Int(0);
+				size_t to = _graph.target(next);
+				transfers.push_back(Edge{
+					NodeId(from),
+					NodeId(to),
+					token,
+					_graph.capacities()[next] - _residual[next]
+				});
+				if (--incoming[to] == 0)
+					queue.push_back(to);
 			}
 		}
-
-	erase_if(_nodeBalances, [](auto& _a) { return _a.second == Int(0); });
-
+	}
 	return transfers;
 }
 
-
-vector<Edge> extractTransfers(Address const& _source, Address const& _sink, Int _amount, map<Node, map<Node, Int>> _usedEdges)
+namespace
 {
-	vector<Edge> transfers;
 
-	map<Address, Int> nodeBalances;
-	nodeBalances[_source] = _amount;
-	while (
-		!nodeBalances.empty() &&
-		(nodeBalances.size() > 1 || nodeBalances.begin()->first != _sink)
-	)
+/// The arcs of a flow that carry a positive amount, prepared for pruning:
+/// The arcs are kept in ordered sets keyed by (flow, arc), globally, per tail,
+/// per head and per path length bucket. Arc ids are assigned in (tail, head)
+/// order, so the smallest element of each set is the smallest arc with the
+/// same tie-breaking as a scan over a map of maps, and updating the flow of an
+/// arc is logarithmic.
+class FlowSubgraph
+{
+public:
+	FlowSubgraph(CSRGraph const& _graph, vector<Int> const& _residual);
+
+	/// Sorts the arcs into buckets by the length of the shortest source-sink
+	/// path through them, longest paths first.
+	void computeBuckets(size_t _source, size_t _sink);
+	size_t bucketCount() const { return m_bucketArcs.size(); }
+	/// The arcs in bucket @a _bucket, in (tail, head) order.
+	vector<size_t> const& bucketArcs(size_t _bucket) const { return m_bucketArcs[_bucket]; }
+
+	Int const& flow(size_t _arc) const { return m_flow[_arc]; }
+	/// @returns the arc with the smallest flow overall.
+	optional<size_t> smallestArc() const { return smallest(m_all); }
+	/// @returns the arc with the smallest flow in bucket @a _bucket.
+	optional<size_t> smallestArcInBucket(size_t _bucket) const { return smallest(m_buckets[_bucket]); }
+
+	/// Removes @a _flowToPrune from @a _arc (or less if the arc is too small),
+	/// together with the flow along a path from the source and to the sink through it.
+	/// Returns the remaining flow to prune if the arc was too small.
+	Int pruneArc(size_t _arc, Int _flowToPrune);
+
+	/// Writes the remaining flow back into the residual capacities.
+	void applyTo(CSRGraph const& _graph, vector<Int>& _residual) const;
+
+private:
+	using Key = pair<Int, size_t>;
+
+	static optional<size_t> smallest(set<Key> const& _arcs)
 	{
-		auto next = extractNextTransfers(_usedEdges, nodeBalances);
-		if (next.empty())
-			// TODO this should actually not happen.
-			break;
-		transfers += move(next);
+		if (_arcs.empty())
+			return nullopt;
+		return _arcs.begin()->second;
 	}
-
-	return transfers;
-}
-
-map<Node, int> distanceFromSource(Node const& _source, map<Node, map<Node, Int>> const& _usedEdges)
+	void prune(size_t _node, Int _flowToPrune, bool _forward);
+	void reduceFlow(size_t _arc, Int const& _amount);
+	vector<size_t> distances(size_t _start, bool _forward) const;
+
+	static size_t constexpr NoBucket = numeric_limits<size_t>::max();
+
+	/// The arc in the CSRGraph.
+	vector<size_t> m_arc;
+	vector<size_t> m_tail;
+	vector<size_t> m_head;
+	vector<Int> m_flow;
+	vector<size_t> m_bucket;
+	vector<vector<size_t>> m_outArcs;
+	vector<vector<size_t>> m_inArcs;
+	set<Key> m_all;
+	vector<set<Key>> m_out;
+	vector<set<Key>> m_in;
+	vector<set<Key>> m_buckets;
+	vector<vector<size_t>> m_bucketArcs;
+};
+
+FlowSubgraph::FlowSubgraph(CSRGraph const& _graph, vector<Int> const& _residual):
+	m_outArcs(_graph.nodeCount()),
+	m_inArcs(_graph.nodeCount()),
+	m_out(_graph.nodeCount()),
+	m_in(_graph.nodeCount())
 {
-	map<Node, int> distances;
-	deque<Node> toProcess;
-	distances[_source] = 0;
-	toProcess.push_back(_source);
-	while (!toProcess.empty())
+	vector<tuple<size_t, size_t, size_t>> arcs;
+	for (size_t node = 0; node < _graph.nodeCount(); ++node)
+		for (size_t arc = _graph.arcsBegin(node); arc != _graph.arcsEnd(node); ++arc)
+			if (_residual[arc] < _graph.capacities()[arc])
+				arcs.emplace_back(node, _graph.target(arc), arc);
+	sort(arcs.begin(), arcs.end());
+	for (auto&& [tail, head, graphArc]: arcs)
 	{
-		Node n = toProcess.front();
-		toProcess.pop_front();
-		if (_usedEdges.count(n))
-			for (auto&& [t, weight]: _usedEdges.at(n))
-				if (weight != Int(0) && !distances.count(t))
-				{
-					distances[t] = distances[n] + 1;
-					toProcess.push_back(t);
-				}
+		size_t arc = m_flow.size();
+		Int flow = _graph.capacities()[graphArc] - _residual[graphArc];
+		m_arc.push_back(graphArc);
+		m_tail.push_back(tail);
+		m_head.push_back(head);
+		m_flow.push_back(flow);
+		m_bucket.push_back(NoBucket);
+		m_outArcs[tail].push_back(arc);
+		m_inArcs[head].push_back(arc);
+		m_all.emplace(flow, arc);
+		m_out[tail].emplace(flow, arc);
+		m_in[head].emplace(flow, arc);
 	}
-	return distances;
-}
-
-map<Node, map<Node, Int>> reverseEdges(map<Node, map<Node, Int>> const& _usedEdges)
-{
-	map<Node, map<Node, Int>> reverseEdges;
-	for (auto&& [n, edges]: _usedEdges)
-		for (auto&& [t, weight]: edges)
-			reverseEdges[t][n] = weight;
-	return reverseEdges;
-}
-
-map<Node, int> distanceToSink(Node const& _sink, map<Node, map<Node, Int>> const& _usedEdges)
-{
-	return distanceFromSource(_sink, reverseEdges(_usedEdges));
 }
 
-/// Returns a map from the negative shortest path length to the edge.
-/// The shortest path length is negative so that it is sorted by
-/// longest paths first - those are the ones we want to eliminate first.
-map<int, set<pair<Node, Node>>> computeEdgesByPathLength(
-	Node const& _source,
-	Node const& _sink,
-	map<Node, map<Node, Int>> const& _usedEdges
-)
+void FlowSubgraph::computeBuckets(size_t _source, size_t _sink)
 {
-	map<Node, int> fromSource = distanceFromSource(_source, _usedEdges);
-	map<Node, int> toSink = distanceToSink(_sink, _usedEdges);
-	map<int, set<pair<Node, Node>>> result;
-	for (auto&& [s, edges]: _usedEdges)
-		for (auto&& [t, weight]: edges)
+	vector<size_t> fromSource = distances(_source, true);
+	vector<size_t> toSink = distances(_sink, false);
+	// Note the path length is negative to sort by longest shortest path first.
+	map<int, vector<size_t>> arcsByPathLength;
+	for (size_t arc = 0; arc < m_flow.size(); ++arc)
+		arcsByPathLength[-int(fromSource[m_tail[arc]] + 1 + toSink[m_head[arc]])].push_back(arc);
+	for (auto& [pathLength, arcs]: arcsByPathLength)
+	{
+		set<Key>& bucket = m_buckets.emplace_back();
+		for (size_t arc: arcs)
 		{
-			int pathLength = fromSource.at(s) + 1 + toSink.at(t);
-			result[-pathLength].emplace(s, t);
+			m_bucket[arc] = m_bucketArcs.size();
+			bucket.emplace(m_flow[arc], arc);
 		}
-	return result;
+		m_bucketArcs.emplace_back(move(arcs));
+	}
 }
 
-
-pair<Node, Node> smallestEdge(map<Node, map<Node, Int>> const& _usedEdges)
+Int FlowSubgraph::pruneArc(size_t _arc, Int _flowToPrune)
 {
-	assert(!_usedEdges.empty());
-	optional<Int> cap;
-	optional<pair<Node, Node>> edge;
-	for (auto&& [a, out]: _usedEdges)
-		for (auto&& [b, c]: out)
-			if (c != Int(0) && (!cap || c < *cap))
-			{
-				cap = c;
-				edge = {a, b};
-			}
-	assert(edge);
-	return *edge;
+	Int amount = min(m_flow[_arc], _flowToPrune);
+	reduceFlow(_arc, amount);
+	prune(m_head[_arc], amount, true);
+	prune(m_tail[_arc], amount, false);
+	return _flowToPrune - amount;
 }
 
-optional<pair<Node, Node>> smallestEdgeInSet(map<Node, map<Node, Int>> const& _usedEdges, set<pair<Node, Node>> const& _edges)
+void FlowSubgraph::applyTo(CSRGraph const& _graph, vector<Int>& _residual) const
 {
-	assert(!_usedEdges.empty());
-	optional<Int> cap;
-	optional<pair<Node, Node>> edge;
-	for (auto&& [a, b]: _edges)
-		if (_usedEdges.count(a) && _usedEdges.at(a).count(b))
-		{
-			Int edgeCapacity = _usedEdges.at(a).at(b);
-			if (edgeCapacity != Int(0))
-				if (!cap || edgeCapacity < *cap)
-				{
-					cap = move(edgeCapacity);
-					edge = {a, b};
-				}
-		}
-	return edge;
+	for (size_t arc = 0; arc < m_flow.size(); ++arc)
+	{
+		_residual[m_arc[arc]] = _graph.capacities()[m_arc[arc]] - m_flow[arc];
+		_residual[_graph.reverse(m_arc[arc])] = m_flow[arc];
+	}
 }
 
-optional<Node> smallestEdgeTo(map<Node, map<Node, Int>> const& _usedEdges, Node const& _dest)
+void FlowSubgraph::prune(size_t _node, Int _flowToPrune, bool _forward)
 {
-	optional<Int> cap;
-	optional<Node> src;
-	for (auto&& [a, out]: _usedEdges)
-		if (out.count(_dest))
-		{
-			Int c = out.at(_dest);
-			if (c != Int(0) && (!cap || c < *cap))
-			{
-				cap = c;
-				src = a;
-			}
-		}
-	return src;
-}
+	while (true)
+	{
+		optional<size_t> arc = smallest(_forward ? m_out[_node] : m_in[_node]);
+		if (!arc)
+			return; // we reached the source / sink
 
-optional<Node> smallestEdgeFrom(map<Node, map<Node, Int>> const& _usedEdges, Node const& _src)
-{
-	if (!_usedEdges.count(_src))
-		return nullopt;
-	optional<Int> cap;
-	optional<Node> dest;
-	for (auto&& [b, c]: _usedEdges.at(_src))
-		if (c != Int(0) && (!cap || c < *cap))
-		{
-			cap = c;
-			dest = b;
-		}
-	return dest;
+		Int amount = min(m_flow[*arc], _flowToPrune);
+		reduceFlow(*arc, amount);
+		prune(_forward ? m_head[*arc] : m_tail[*arc], amount, _forward);
+		_flowToPrune -= amount;
+		if (_flowToPrune == Int(0))
+			return;
+	}
 }
 
-void reduceCapacity(map<Node, map<Node, Int>>& _usedEdges, Node _a, Node _b, Int const& _capacity)
+void FlowSubgraph::reduceFlow(size_t _arc, Int const& _amount)
 {
-	_usedEdges[_a][_b] -= _capacity;
-	if (_usedEdges[_a][_b] == Int(0))
-		_usedEdges[_a].erase(_b);
+	Key key{m_flow[_arc], _arc};
+	m_all.erase(key);
+	m_out[m_tail[_arc]].erase(key);
+	m_in[m_head[_arc]].erase(key);
+	if (m_bucket[_arc] != NoBucket)
+		m_buckets[m_bucket[_arc]].erase(key);
+
+	m_flow[_arc] -= _amount;
+	if (m_flow[_arc] == Int(0))
+		return;
+
+	key.first = m_flow[_arc];
+	m_all.insert(key);
+	m_out[m_tail[_arc]].insert(key);
+	m_in[m_head[_arc]].insert(key);
+	if (m_bucket[_arc] != NoBucket)
+		m_buckets[m_bucket[_arc]].insert(key);
 }
 
-void prune(map<Node, map<Node, Int>>& _usedEdges, Node _n, Int _flowToPrune, bool _forward)
+/// @returns the BFS distance of all nodes from @a _start (forward) or to
+/// @a _start (backward) along arcs with flow.
+vector<size_t> FlowSubgraph::distances(size_t _start, bool _forward) const
 {
-	while (true)
+	vector<size_t> distance(m_outArcs.size(), numeric_limits<size_t>::max());
+	vector<size_t> queue{_start};
+	distance[_start] = 0;
+	for (size_t head = 0; head < queue.size(); ++head)
 	{
-		optional<Node> a = _forward ? smallestEdgeFrom(_usedEdges, _n) : smallestEdgeTo(_usedEdges, _n);
-		if (!a)
-			return; // we reached the source / sink
-
-		Int cap = _forward ? _usedEdges[_n][*a] : _usedEdges[*a][_n];
-		if (cap >= _flowToPrune)
-			cap = _flowToPrune;
-		if (_forward)
-			reduceCapacity(_usedEdges, _n, *a, cap);
-		else
-			reduceCapacity(_usedEdges, *a, _n, cap);
-		prune(_usedEdges, *a, cap, _forward);
-		_flowToPrune -= cap;
-		if (_flowToPrune == Int(0))
-			return;
+		size_t node = queue[head];
+		for (size_t arc: _forward ? m_outArcs[node] : m_inArcs[node])
+		{
+			size_t next = _forward ? m_head[arc] : m_tail[arc];
+			if (distance[next] == numeric_limits<size_t>::max())
+			{
+				distance[next] = distance[node] + 1;
+				queue.push_back(next);
+			}
+		}
 	}
+	return distance;
 }
 
-/// Removes the edge (potentially partially), removing a given amount of flow.
-/// Returns the remaining flow to prune if the edge was too small.
-Int pruneEdge(map<Node, map<Node, Int>>& _usedEdges, pair<Node, Node> const& _edge, Int _flowToPrune)
-{
-	Node a = _edge.first;
-	Node b = _edge.second;
-	Int edgeSize = _usedEdges[a][b];
-	if (edgeSize > _flowToPrune)
-		edgeSize = _flowToPrune;
-//	cerr << "Pruning an edge of size " << edgeSize << endl;
-//	cerr << "Flow to prune: " << _flowToPrune << endl;
-	reduceCapacity(_usedEdges, a, b, edgeSize);
-	prune(_usedEdges, b, edgeSize, true);
-	prune(_usedEdges, a, edgeSize, false);
-	return _flowToPrune - edgeSize;
 }
 
 pair<Int, vector<Edge>> computeFlow(
-	Address const& _source,
-	Address const& _sink,
-#if USE_FLOW
-	map<Node, map<Node, Int>> const& adjacencies,
-#else
-	set<Edge> const& _edges,
-#endif
+	NodeId _source,
+	NodeId _sink,
+	CSRGraph const& _graph,
 	Int _requestedFlow,
-	bool _prune
+	bool _prune,
+	FlowEngine _engine,
+	bool _bounded
 )
 {
-	cerr << "Got " << _edges.size() << " edges" << endl;
-#if USE_FLOW
-	map<Node, map<Node, Int>> capacities = adjacencies;
-#else
-
-	Adjacencies adjacencies(_edges);
-#endif
-	//cerr << "Number of nodes (including pseudo-nodes): " << capacities.size() << endl;
+	cerr << "Got " << _graph.edgeCount() << " edges" << endl;
+	if (_source >= _graph.realNodeCount() || _sink >= _graph.realNodeCount())
+		return {Int(0), {}};
 
-	map<Node, map<Node, Int>> usedEdges;
+	vector<Int> residual = _graph.capacities();
 
 	cerr << "Computing max flow..." << endl;
 	auto t1 = chrono::high_resolution_clock::now();
-	// First always compute the max flow.
+	// In bounded mode, there is nothing to prune afterwards. Pruning by path length
+	// needs the full max flow, so it implies the unbounded mode.
+	Int limit = _bounded && !_prune ? _requestedFlow : Int::max();
 	Int flow{0};
-	while (true)
+	switch (_engine)
 	{
-		auto [newFlow, parents] = augmentingPath(_source, _sink, adjacencies);
-		//cerr << "Found augmenting path with flow " << newFlow << endl;
-		//cerr << "Parents: " << parents.size() << endl;
-		if (newFlow == Int(0))
-			break;
-		flow += newFlow;
-		for (Node node = _sink; node != Node{_source}; )
-		{
-			Node const& prev = parents[node];
-			adjacencies.adjustCapacity(prev, node, -newFlow);
-			adjacencies.adjustCapacity(node, prev, newFlow);
-			// TODO still not sure about this one.
-			if (!adjacencies.isAdjacent(node, prev))
-				// real edge
-				usedEdges[prev][node] += newFlow;
-			else
-				// (partial) edge removal
-				usedEdges[node][prev] -= newFlow;
-			node = prev;
-		}
+	case FlowEngine::EdmondsKarp:
+		flow = edmondsKarp(_graph, residual, _source, _sink, limit);
+		break;
+	case FlowEngine::Dinic:
+		flow = dinic(_graph, residual, _source, _sink, limit);
+		break;
+	case FlowEngine::PushRelabel:
+		flow = pushRelabel(_graph, residual, _source, _sink, limit);
+		break;
 	}
-	cerr << "Max flow " << flow << " using " << usedEdges.size() << " nodes/edges " << endl;
+	// The transfer extraction needs an acyclic flow.
+	cancelFlowCycles(_graph, residual);
 	auto t2 = chrono::high_resolution_clock::now();
+	cerr << "Max flow " << flow << endl;
 	cerr << "Took " << chrono::duration_cast<chrono::duration<double>>(t2 - t1).count() << endl;
 	cerr << "Pruning..." << endl;
 	auto t3 = chrono::high_resolution_clock::now();
-	if (_prune && flow > _requestedFlow)
+	if (flow > _requestedFlow)
 	{
-		cerr << "Pruning according to new algorithm..." << endl;
-		// Note the path length is negative to sort by longest shortest path first.
-		map<int, set<pair<Node, Node>>> edgesByPathLength = computeEdgesByPathLength(_source, _sink, usedEdges);
+		FlowSubgraph subgraph(_graph, residual);
 		Int flowToPrune = flow - _requestedFlow;
-		for (auto&& [pathLength, edgesHere]: edgesByPathLength)
+		if (_prune)
 		{
-			// As long as `edges` contain an edge with smaller weight than the weight still to prune:
-			//   take the smallest such edge and prune it.
-			while (flowToPrune > Int{0})
+			cerr << "Pruning according to new algorithm..." << endl;
+			subgraph.computeBuckets(_source, _sink);
+			for (size_t bucket = 0; bucket < subgraph.bucketCount(); ++bucket)
 			{
-				auto smallestEdge = smallestEdgeInSet(usedEdges, edgesHere);
-				if (!smallestEdge || usedEdges[smallestEdge->first][smallestEdge->second] > flowToPrune)
-					break;
-				flowToPrune = pruneEdge(usedEdges, *smallestEdge, flowToPrune);
+				// As long as the bucket contains an edge with smaller weight than the weight still to prune:
+				//   take the smallest such edge and prune it.
+				while (flowToPrune > Int{0})
+				{
+					optional<size_t> smallestArc = subgraph.smallestArcInBucket(bucket);
+					if (!smallestArc || subgraph.flow(*smallestArc) > flowToPrune)
+						break;
+					flowToPrune = subgraph.pruneArc(*smallestArc, flowToPrune);
+				}
 			}
-		}
-		// If there is still flow to prune, take the first element in edgesByPathLength
-		// and partially prune its path.
-		if (flowToPrune > Int{0})
-			for (auto&& [pathLength, edges]: edgesByPathLength)
-			{
-				for (auto&& edge: edges)
+			// If there is still flow to prune, take the first edge in the
+			// longest path bucket and partially prune its path.
+			for (size_t bucket = 0; bucket < subgraph.bucketCount() && flowToPrune > Int{0}; ++bucket)
+				for (size_t arc: subgraph.bucketArcs(bucket))
 				{
-					flowToPrune = pruneEdge(usedEdges, edge, flowToPrune);
+					if (subgraph.flow(arc) != Int{0})
+						flowToPrune = subgraph.pruneArc(arc, flowToPrune);
 					if (flowToPrune == Int{0})
 						break;
 				}
-				if (flowToPrune == Int{0})
-					break;
-			}
-		flow = _requestedFlow + flowToPrune;
-	}
-	else if (flow > _requestedFlow)
-	{
-		// Now prune edges until the flow is as requested.
-		// (old algorithm)
-		Int flowToPrune = flow - _requestedFlow;
-		while (flowToPrune > Int(0))
-			flowToPrune = pruneEdge(usedEdges, smallestEdge(usedEdges), flowToPrune);
+		}
+		else
+			// Now prune edges until the flow is as requested.
+			// (old algorithm)
+			while (flowToPrune > Int(0))
+				flowToPrune = subgraph.pruneArc(*subgraph.smallestArc(), flowToPrune);
+		require(flowToPrune == Int{0});
 		flow = _requestedFlow;
+		subgraph.applyTo(_graph, residual);
 	}
 
 	auto t4 = chrono::high_resolution_clock::now();
 	cerr << "Took " << chrono::duration_cast<chrono::duration<double>>(t4 - t3).count() << endl;
 
-	assert(flowToPrune == Int{0});
 	cerr << "Computing transfers..." << endl;
 	auto t5 = chrono::high_resolution_clock::now();
-	auto transfers = extractTransfers(_source, _sink, flow, usedEdges);
+	auto transfers = extractTransfers(_graph, residual, _source);
 	auto t6 = chrono::high_resolution_clock::now();
 	cerr << "Took " << chrono::duration_cast<chrono::duration<double>>(t6 - t5).count() << endl;
 	return {flow, move(transfers)};
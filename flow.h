@@ -2,16 +2,34 @@
 
 #include "types.h"
 
-#define USE_FLOW 0
+#include <string>
 
+class CSRGraph;
+
+/// Algorithm used to compute the max flow.
+enum class FlowEngine
+{
+	EdmondsKarp,
+	Dinic,
+	PushRelabel
+};
+
+/// @returns the engine called @a _name ("edmondsKarp", "dinic" or "pushRelabel").
+/// Throws InvalidArgumentException for unknown names.
+FlowEngine flowEngineFromName(std::string const& _name);
+
+/// Computes a flow of at most @a _requestedFlow from @a _source to @a _sink
+/// and returns its value together with the transfers that realize it.
+/// If @a _bounded is set and @a _prune is not, the max-flow engine stops as soon
+/// as the requested value is reached. Otherwise, the full max flow is computed and
+/// then pruned, removing the longest paths first if @a _prune is set and the
+/// smallest edges first if not.
 std::pair<Int, std::vector<Edge>> computeFlow(
-	Address const& _source,
-	Address const& _sink,
-#if USE_FLOW
-	std::map<FlowGraphNode, std::map<FlowGraphNode, Int>> const& _adjacencies,
-#else
-	std::set<Edge> const& _edges,
-#endif
+	NodeId _source,
+	NodeId _sink,
+	CSRGraph const& _graph,
 	Int _requestedFlow = Int::max(),
-	bool _prune = false
+	bool _prune = false,
+	FlowEngine _engine = FlowEngine::EdmondsKarp,
+	bool _bounded = true
 );
@@ -15,14 +15,14 @@
 using namespace std;
 using json = nlohmann::json;
 
-void edgeSetToJson(set<Edge> const& _edges, char const* _file)
+void edgeSetToJson(set<Edge> const& _edges, AddressInterner const& _addresses, char const* _file)
 {
 	json edges = json::array();
 	for (Edge const& edge: _edges)
 		edges.push_back(json{
-			{"from", to_string(edge.from)},
-			{"to", to_string(edge.to)},
-			{"token", to_string(edge.token)},
+			{"from", _addresses.addressString(edge.from)},
+			{"to", _addresses.addressString(edge.to)},
+			{"token", _addresses.addressString(edge.token)},
 			{"capacity", to_string(edge.capacity)}
 		});
 
@@ -33,7 +33,7 @@ void edgeSetToJson(set<Edge> const& _edges, char const* _file)
 
 
 
-set<Edge> importEdgesJson(string const& _file)
+set<Edge> importEdgesJson(string const& _file, AddressInterner& _addresses)
 {
 	ifstream f(_file);
 	json edgesJson;
@@ -51,9 +51,9 @@ set<Edge> importEdgesJson(string const& _file)
 			Int(uint64_t(edge["capacity"])) :
 			Int(string(edge["capacity"]));
 		edges.insert(Edge{
-			Address(string(edge["from"])),
-			Address(string(edge["to"])),
-			Address(string(edge["token"])),
+			_addresses.intern(Address(string(edge["from"]))),
+			_addresses.intern(Address(string(edge["to"]))),
+			_addresses.intern(Address(string(edge["token"]))),
 			move(capacity)
 		});
 	}
@@ -62,19 +62,19 @@ set<Edge> importEdgesJson(string const& _file)
 }
 
 
-void edgeSetToBinary(set<Edge> const& _edges, string const& _file)
+void edgeSetToBinary(set<Edge> const& _edges, AddressInterner const& _addresses, string const& _file)
 {
-	BinaryExporter(_file).write(_edges);
+	BinaryExporter(_file).write(_edges, _addresses);
 }
 
-set<Edge> importEdgesBinary(istream& _file)
+set<Edge> importEdgesBinary(istream& _file, AddressInterner& _addresses)
 {
-	return BinaryImporter(_file).readEdgeSet();
+	return BinaryImporter(_file).readEdgeSet(_addresses);
 }
 
-set<Edge> importEdgesBinary(string const& _file)
+set<Edge> importEdgesBinary(string const& _file, AddressInterner& _addresses)
 {
 	ifstream f(_file);
-	return importEdgesBinary(f);
+	return importEdgesBinary(f, _addresses);
 }
 
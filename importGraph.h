@@ -10,10 +10,10 @@
 /*
 std::set<Edge> findEdgesInGraphData(DB const& _db);
 
-void edgeSetToJson(std::set<Edge> const& _edges, char const* _file);
-std::set<Edge> importEdgesJson(std::string const& _file);
+void edgeSetToJson(std::set<Edge> const& _edges, AddressInterner const& _addresses, char const* _file);
+std::set<Edge> importEdgesJson(std::string const& _file, AddressInterner& _addresses);
 
-void edgeSetToBinary(std::set<Edge> const& _edges, std::string const& _file);
-std::set<Edge> importEdgesBinary(std::string const& _file);
-std::set<Edge> importEdgesBinary(std::istream& _stream);
+void edgeSetToBinary(std::set<Edge> const& _edges, AddressInterner const& _addresses, std::string const& _file);
+std::set<Edge> importEdgesBinary(std::string const& _file, AddressInterner& _addresses);
+std::set<Edge> importEdgesBinary(std::istream& _stream, AddressInterner& _addresses);
 */
@@ -0,0 +1,196 @@
+#include "journal.h"
+
+#include "binaryExporter.h"
+#include "binaryImporter.h"
+#include "db.h"
+#include "exceptions.h"
+#include "mappedFile.h"
+
+#include <filesystem>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+
+/// @returns the position encoded in a file name of the form "<prefix>-<block>-<logIndex>.dat".
+optional<JournalPosition> parsePosition(string const& _name, string const& _prefix)
+{
+	string const suffix = ".dat";
+	if (
+		_name.size() <= _prefix.size() + 1 + suffix.size() ||
+		_name.compare(0, _prefix.size() + 1, _prefix + "-") != 0 ||
+		_name.compare(_name.size() - suffix.size(), suffix.size(), suffix) != 0
+	)
+		return nullopt;
+	string position = _name.substr(_prefix.size() + 1, _name.size() - _prefix.size() - 1 - suffix.size());
+	size_t dash = position.find('-');
+	if (dash == string::npos || dash == 0 || dash + 1 == position.size())
+		return nullopt;
+	if (position.find_first_not_of("0123456789-") != string::npos || position.find('-', dash + 1) != string::npos)
+		return nullopt;
+	return JournalPosition{size_t(stoull(position.substr(0, dash))), size_t(stoull(position.substr(dash + 1)))};
+}
+
+/// @returns the files in @a _directory whose names start with @a _prefix, sorted by their position.
+vector<pair<JournalPosition, string>> listFiles(string const& _directory, string const& _prefix)
+{
+	vector<pair<JournalPosition, string>> files;
+	for (auto const& entry: filesystem::directory_iterator(_directory))
+		if (optional<JournalPosition> position = parsePosition(entry.path().filename().string(), _prefix))
+			files.emplace_back(*position, entry.path().string());
+	sort(files.begin(), files.end());
+	return files;
+}
+
+}
+
+bool applyEvent(DB& _db, Event const& _event)
+{
+	if (auto const* signup = get_if<SignupEvent>(&_event))
+		_db.signup(signup->user, signup->token);
+	else if (auto const* organizationSignup = get_if<OrganizationSignupEvent>(&_event))
+		_db.organizationSignup(organizationSignup->organization);
+	else if (auto const* trust = get_if<TrustEvent>(&_event))
+		_db.trust(trust->canSendTo, trust->user, trust->limitPercentage);
+	else if (auto const* transfer = get_if<TransferEvent>(&_event))
+		return _db.transfer(transfer->token, transfer->from, transfer->to, transfer->value);
+	return true;
+}
+
+Journal::Journal(string _directory, size_t _snapshotInterval):
+	m_directory(move(_directory)),
+	m_snapshotInterval(_snapshotInterval)
+{
+	filesystem::create_directories(m_directory);
+}
+
+Journal::~Journal() = default;
+
+optional<JournalPosition> Journal::restore(DB& _db)
+{
+	vector<pair<JournalPosition, string>> snapshots = listFiles(m_directory, "snapshot");
+	if (snapshots.empty())
+		return nullopt;
+	auto const& [snapshotPosition, snapshotFile] = snapshots.back();
+	cerr << "Loading snapshot " << snapshotFile << endl;
+	_db = readDBFile(snapshotFile).second;
+	m_snapshotPosition = m_position = snapshotPosition;
+	m_positions = JournalPositions{snapshotPosition, snapshotPosition, {}};
+	string positionsFile = fileName("positions", snapshotPosition);
+	if (filesystem::exists(positionsFile))
+	{
+		MappedFile file(positionsFile);
+		m_positions = BinaryImporter(file.data(), file.size()).readJournalPositions();
+	}
+	m_replayedEvents = 0;
+
+	bool incomplete = false;
+	_db.delayEdgeUpdates();
+	for (auto const& [journalPosition, journalFile]: listFiles(m_directory, "journal"))
+	{
+		MappedFile file(journalFile);
+		auto [entries, validLength] = BinaryImporter(file.data(), file.size()).readJournal();
+		for (JournalEntry const& entry: entries)
+			if (isNew(entry.position))
+			{
+				applyEvent(_db, entry.event);
+				record(entry);
+				m_replayedEvents++;
+			}
+		if (validLength < file.size())
+		{
+			cerr << "Ignoring incomplete entry at the end of " << journalFile << endl;
+			incomplete = true;
+		}
+	}
+	_db.performEdgeUpdates();
+	cerr << "Replayed " << m_replayedEvents << " events." << endl;
+
+	// Continue in a fresh journal file unless the existing one can be extended as it is.
+	if (m_replayedEvents > 0 || incomplete)
+		writeSnapshot(_db);
+	else
+		m_file = make_unique<BinaryExporter>(fileName("journal", m_snapshotPosition), true);
+	return m_positions.complete();
+}
+
+void Journal::start(DB const& _db, size_t _blockNumber)
+{
+	m_position =
+		_blockNumber > 0 ?
+		JournalPosition{_blockNumber - 1, numeric_limits<size_t>::max()} :
+		JournalPosition{};
+	m_positions = JournalPositions{m_position, m_position, {}};
+	m_replayedEvents = 0;
+	writeSnapshot(_db);
+}
+
+void Journal::append(JournalEntry const& _entry, DB const& _db)
+{
+	require(m_file && isNew(_entry.position));
+	m_file->write(_entry);
+	m_file->flush();
+	record(_entry);
+	m_eventsSinceSnapshot++;
+	snapshotIfDue(_db);
+}
+
+void Journal::record(JournalEntry const& _entry)
+{
+	JournalPosition& newest =
+		holds_alternative<TransferEvent>(_entry.event) ?
+		m_positions.transfers :
+		m_positions.hubEvents;
+	newest = max(newest, _entry.position);
+	m_positions.applied.insert(_entry.position);
+	m_positions.applied.erase(
+		m_positions.applied.begin(),
+		m_positions.applied.upper_bound(m_positions.complete())
+	);
+	m_position = max(m_position, _entry.position);
+}
+
+void Journal::snapshotIfDue(DB const& _db)
+{
+	if (m_eventsSinceSnapshot > 0 && m_eventsSinceSnapshot >= m_snapshotInterval && !_db.hasPendingEdgeUpdates())
+		writeSnapshot(_db);
+}
+
+void Journal::writeSnapshot(DB const& _db)
+{
+	// Events before the newest one do not advance m_position, but the files of the new snapshot
+	// must not replace the previous ones, which are still needed if writing them fails.
+	if (!(m_snapshotPosition < m_position))
+		m_position =
+			m_snapshotPosition.logIndex < numeric_limits<size_t>::max() ?
+			JournalPosition{m_snapshotPosition.blockNumber, m_snapshotPosition.logIndex + 1} :
+			JournalPosition{m_snapshotPosition.blockNumber + 1, 0};
+	string snapshot = fileName("snapshot", m_position);
+	string positions = fileName("positions", m_position);
+	cerr << "Writing snapshot " << snapshot << endl;
+	// Write to temporary files first, so that a crash never leaves an incomplete snapshot.
+	// The positions are written first, so that a snapshot never exists without them.
+	BinaryExporter(positions + ".tmp").write(m_positions);
+	filesystem::rename(positions + ".tmp", positions);
+	BinaryExporter(snapshot + ".tmp").write(m_position.blockNumber, _db, DBFormat::V3);
+	filesystem::rename(snapshot + ".tmp", snapshot);
+	m_file = make_unique<BinaryExporter>(fileName("journal", m_position));
+	m_snapshotPosition = m_position;
+	m_eventsSinceSnapshot = 0;
+
+	for (char const* prefix: {"snapshot", "positions", "journal"})
+		for (auto const& [position, file]: listFiles(m_directory, prefix))
+			if (position < m_snapshotPosition)
+				filesystem::remove(file);
+}
+
+string Journal::fileName(string const& _prefix, JournalPosition const& _position) const
+{
+	return (
+		filesystem::path(m_directory) /
+		(_prefix + "-" + to_string(_position.blockNumber) + "-" + to_string(_position.logIndex) + ".dat")
+	).string();
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "types.h"
+
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <tuple>
+#include <variant>
+
+struct DB;
+class BinaryExporter;
+
+struct SignupEvent
+{
+	Address user;
+	Address token;
+};
+
+struct OrganizationSignupEvent
+{
+	Address organization;
+};
+
+struct TrustEvent
+{
+	Address canSendTo;
+	Address user;
+	uint32_t limitPercentage = 0;
+};
+
+struct TransferEvent
+{
+	Address token;
+	Address from;
+	Address to;
+	Int value;
+};
+
+/// Blockchain event that changes the database.
+using Event = std::variant<SignupEvent, OrganizationSignupEvent, TrustEvent, TransferEvent>;
+
+/// Applies @a _event to @a _db using DB::signup, DB::trust etc.
+/// @returns false if @a _db ignored the event, see DB::transfer.
+bool applyEvent(DB& _db, Event const& _event);
+
+/// Position of an event log in the chain.
+struct JournalPosition
+{
+	size_t blockNumber = 0;
+	size_t logIndex = 0;
+
+	bool operator<(JournalPosition const& _other) const
+	{
+		return std::tie(blockNumber, logIndex) < std::tie(_other.blockNumber, _other.logIndex);
+	}
+};
+
+struct JournalEntry
+{
+	JournalPosition position;
+	Event event;
+};
+
+/// Positions of the events contained in a snapshot, stored next to it, see Journal.
+struct JournalPositions
+{
+	/// Position of the newest hub event (signup, organization signup or trust).
+	JournalPosition hubEvents;
+	/// Position of the newest transfer.
+	JournalPosition transfers;
+	/// Positions of the events after complete().
+	std::set<JournalPosition> applied;
+
+	/// @returns the position up to which all events are contained.
+	JournalPosition const& complete() const { return transfers < hubEvents ? transfers : hubEvents; }
+};
+
+/// Append-only journal of the applied events together with periodic snapshots
+/// of the database, so that a restart only has to load the newest snapshot and
+/// replay the events after it.
+///
+/// The directory contains files "snapshot-<block>-<logIndex>.dat" (version 3 db.dat files),
+/// "positions-<block>-<logIndex>.dat" with the JournalPositions of the snapshot and
+/// "journal-<block>-<logIndex>.dat" with the events applied after the snapshot, where
+/// the position is that of the newest event before the snapshot (or just after the previous
+/// snapshot if that is newer, so that the names increase), see BinaryExporter::write(JournalEntry const&).
+///
+/// pathfinderd applies the hub events of a range of blocks before its transfers, so a
+/// snapshot can contain hub events after transfers that are still missing. Because of that,
+/// the hub events and the transfers are assumed to be applied in order only among themselves.
+/// All events up to the older of the newest hub event and the newest transfer are complete,
+/// the positions of the events after that are kept until they are complete as well.
+/// Snapshots are only written while no edge updates are delayed, so that such a batch is not split.
+/// A snapshot without positions file contains all events up to and including its position.
+class Journal
+{
+public:
+	Journal(std::string _directory, size_t _snapshotInterval);
+	~Journal();
+
+	/// Loads the newest snapshot into @a _db and applies the journaled events after it.
+	/// @returns the position up to which all events are applied, or nothing if there is no snapshot.
+	std::optional<JournalPosition> restore(DB& _db);
+	/// Starts the journal with a snapshot of @a _db, which contains all events before block @a _blockNumber.
+	void start(DB const& _db, size_t _blockNumber);
+
+	/// @returns false if the event at @a _position is already part of the journal or a snapshot.
+	bool isNew(JournalPosition const& _position) const
+	{
+		return m_positions.complete() < _position && !m_positions.applied.count(_position);
+	}
+	/// Appends @a _entry, which has to be new and already applied to @a _db.
+	void append(JournalEntry const& _entry, DB const& _db);
+	/// Writes a snapshot of @a _db if enough events were appended since the last one
+	/// and the edges of @a _db are up to date.
+	void snapshotIfDue(DB const& _db);
+
+	size_t replayedEvents() const { return m_replayedEvents; }
+
+private:
+	/// Adds the position of @a _entry to m_positions.
+	void record(JournalEntry const& _entry);
+	/// Writes a snapshot at the position of the newest event and starts a new journal file after it.
+	/// Older snapshots and journal files are removed afterwards.
+	void writeSnapshot(DB const& _db);
+
+	std::string fileName(std::string const& _prefix, JournalPosition const& _position) const;
+
+	std::string m_directory;
+	size_t m_snapshotInterval = 0;
+	/// Position of the newest snapshot.
+	JournalPosition m_snapshotPosition;
+	/// Position of the newest applied event, or of the newest snapshot if that is newer.
+	JournalPosition m_position;
+	/// Positions of the applied events.
+	JournalPositions m_positions;
+	size_t m_eventsSinceSnapshot = 0;
+	size_t m_replayedEvents = 0;
+	std::unique_ptr<BinaryExporter> m_file;
+};
@@ -4,34 +4,225 @@
 #include "binaryExporter.h"
 #include "binaryImporter.h"
 #include "encoding.h"
+#include "ethLog.h"
+#include "csrGraph.h"
+#include "dbDiff.h"
+#include "dbView.h"
+#include "journal.h"
+#include "mappedFile.h"
+#include "parallel.h"
+#include "workerPool.h"
 
 #include "json.hpp"
 
+#include <algorithm>
 #include <iostream>
-#include <sstream>
 #include <chrono>
+#include <shared_mutex>
 
 using namespace std;
 using json = nlohmann::json;
 
 DB db;
+/// Block number of the loaded snapshot, advanced by applied diffs.
+size_t dbBlockNumber = 0;
 
 namespace
 {
+/// Journal of the events applied in JSON mode, see the openJournal command.
+unique_ptr<Journal> journal;
+
+/// @returns the position given by "blockNumber" and "logIndex" in @a _input, if any.
+optional<JournalPosition> positionFromJson(json const& _input)
+{
+	if (!_input.contains("blockNumber") || !_input.contains("logIndex"))
+		return nullopt;
+	return JournalPosition{size_t(_input["blockNumber"]), size_t(_input["logIndex"])};
+}
+
+/// Thrown by processEvent if the event itself cannot be applied,
+/// e.g. a transfer of more than the balance.
+class EventFailedException: public Exception {};
+
+/// Applies @a _event to the database. If a journal is open, its position is required and
+/// the event is also added to the journal, unless the database ignored it
+/// (e.g. a transfer of an unrelated ERC20 token).
+/// @returns false if the event was skipped because the journal already contains it.
+bool processEvent(optional<JournalPosition> const& _position, Event const& _event)
+{
+	if (journal)
+	{
+		// Otherwise, the event would be lost on the next restart.
+		require(_position);
+		if (!journal->isNew(*_position))
+			return false;
+	}
+	bool changed = false;
+	try
+	{
+		changed = applyEvent(db, _event);
+	}
+	catch (Exception const&)
+	{
+		throw EventFailedException();
+	}
+	if (journal)
+	{
+		if (changed)
+			journal->append(JournalEntry{*_position, _event}, db);
+		dbBlockNumber = max(dbBlockNumber, _position->blockNumber);
+	}
+	return true;
+}
+
+/// @returns the event given by @a _input in the format of the JSON command @a _type,
+/// i.e. "signup", "organizationSignup", "trust" or "transfer".
+Event eventFromJson(string const& _type, json const& _input)
+{
+	if (_type == "signup")
+		return SignupEvent{Address(_input["user"]), Address(_input["token"])};
+	else if (_type == "organizationSignup")
+		return OrganizationSignupEvent{Address(_input["organization"])};
+	else if (_type == "trust")
+		return TrustEvent{
+			Address(_input["canSendTo"]),
+			Address(_input["user"]),
+			uint32_t(_input["limitPercentage"])
+		};
+	else if (_type == "transfer")
+		return TransferEvent{
+			Address(_input["token"]),
+			Address(_input["from"]),
+			Address(_input["to"]),
+			Int(string(_input["value"]))
+		};
+	throw InvalidArgumentException();
+}
+
+/// Applies @a _events in the given order and updates the edges only once at the end,
+/// unless edge updates are delayed anyway.
+/// Events that fail (e.g. a transfer exceeding the balance) do not stop the others,
+/// but other failures (e.g. of the journal) abort the batch.
+json applyEventBatch(vector<pair<optional<JournalPosition>, Event>> const& _events)
+{
+	// Reject the whole batch instead of applying only the events with a position.
+	if (journal)
+		for (auto const& [position, event]: _events)
+			require(position);
+
+	size_t applied = 0;
+	size_t skipped = 0;
+	size_t failed = 0;
+	bool delayed = db.m_delayEdgeUpdates;
+	db.delayEdgeUpdates();
+	db.m_logEvents = false;
+	try
+	{
+		for (auto const& [position, event]: _events)
+			try
+			{
+				if (processEvent(position, event))
+					applied++;
+				else
+					skipped++;
+			}
+			catch (EventFailedException const&)
+			{
+				failed++;
+			}
+	}
+	catch (...)
+	{
+		// The events applied so far are journaled, so only the edges have to be brought up to date.
+		if (!delayed)
+			db.performEdgeUpdates();
+		db.m_logEvents = true;
+		throw;
+	}
+	if (!delayed)
+	{
+		db.performEdgeUpdates();
+		if (journal)
+			journal->snapshotIfDue(db);
+	}
+	db.m_logEvents = true;
+	cerr << "Applied " << applied << " events, skipped " << skipped << ", " << failed << " failed." << endl;
+	return json{{"applied", applied}, {"skipped", skipped}, {"failed", failed}};
+}
+
+/// Applies the events @a _events, each given like the input of the corresponding
+/// command with the command name in "type", see applyEventBatch.
+json applyEventsJson(json const& _events)
+{
+	// Parse all events first, so that invalid input is rejected before anything is applied.
+	vector<pair<optional<JournalPosition>, Event>> events;
+	for (json const& input: _events)
+		events.emplace_back(positionFromJson(input), eventFromJson(input["type"], input));
+	return applyEventBatch(events);
+}
+
+/// Applies the raw logs from eth_getLogs in @a _input["logs"] or in the file @a _input["file"],
+/// which contains either the array of logs or the whole JSON-RPC response, see decodeLog.
+/// Hub events are only accepted from the contract @a _input["hub"], if given.
+/// The hub events are applied before the transfers, so that transfers in the same
+/// blocks as the signup of their token are not ignored.
+json applyLogsJson(json const& _input)
+{
+	json logs;
+	if (_input.contains("file"))
+	{
+		MappedFile file(string{_input["file"]});
+		logs = json::parse(file.data(), file.data() + file.size());
+		if (logs.is_object())
+			logs = move(logs["result"]);
+	}
+	else
+		logs = _input["logs"];
+	optional<Address> hub;
+	if (_input.contains("hub"))
+		hub = Address(string(_input["hub"]));
+
+	vector<pair<optional<JournalPosition>, Event>> events;
+	vector<pair<optional<JournalPosition>, Event>> transfers;
+	for (json const& log: logs)
+		if (optional<JournalEntry> entry = decodeLog(log, hub))
+			(holds_alternative<TransferEvent>(entry->event) ? transfers : events).emplace_back(entry->position, move(entry->event));
+	size_t decoded = events.size() + transfers.size();
+	move(transfers.begin(), transfers.end(), back_inserter(events));
+
+	json result = applyEventBatch(events);
+	result["ignored"] = logs.size() - decoded;
+	return result;
+}
+
+/// Applies the diff file contents @a _data to the loaded database.
+/// @returns the new block number.
+size_t applyDiffToDB(char const* _data, size_t _length)
+{
+	DBDiff diff = BinaryImporter(_data, _length).readDBDiff();
+	require(diff.fromBlock == dbBlockNumber);
+	db.applyDiff(diff);
+	dbBlockNumber = diff.toBlock;
+	return dbBlockNumber;
+}
+
 /// @returns the incoming and outgoing trust edges for a given user with limit percentages.
 json adjacenciesJson(string const& _user)
 {
-	Address user{string(_user)};
-
 	json output = json::array();
-	for (auto const& [address, safe]: db.safes)
-		for (auto const& [sendTo, percentage]: safe.limitPercentage)
-			if (sendTo != address && (user == address || user == sendTo))
-				output.push_back({
-					{"user", to_string(sendTo)},
-					{"percentage", percentage},
-					{"trusts", to_string(user == sendTo ? address : user)}
-				});
+	optional<NodeId> user = db.idMaybe(Address{string(_user)});
+	if (!user)
+		return output;
+
+	for (NodeId id = 0; id < db.safes.size(); ++id)
+		if (Safe const* safe = db.safeMaybe(id))
+			for (auto const& [sendTo, percentage]: safe->limitPercentage)
+				if (sendTo != id && (*user == id || *user == sendTo))
+					output.push_back({
+						{"user", db.addressString(sendTo)},
+						{"percentage", percentage},
+						{"trusts", db.addressString(*user == sendTo ? id : *user)}
+					});
 	return output;
 }
 
@@ -41,43 +232,75 @@ string debugData(vector<Edge> const& _transfers)
 	for (Edge const& t: _transfers)
 	{
 		out +=
-			"Transfer " + to_string(t.from) + " -> " + to_string(t.to) +
+			"Transfer " + db.addressString(t.from) + " -> " + db.addressString(t.to) +
 			" of " + to_string(t.capacity) + " tokens of " +
-			to_string(db.token(t.token).safeAddress) + "\n";
+			db.addressString(db.token(t.token).safe) + "\n";
 		out +=
 			"to is org: " + (db.safe(t.to).organization ? "- true"s : "- false"s) +
 			" trust perc: " + to_string(db.safe(t.from).sendToPercentage(t.to)) +
-			" sender token balance from " + to_string(db.safe(t.from).balance(db.safe(t.from).tokenAddress)) +
-			" to " + to_string(db.safe(t.to).balance(db.safe(t.from).tokenAddress)) +
-			" receiver token receiver balance " + to_string(db.safe(t.to).balance(db.safe(t.to).tokenAddress)) +
+			" sender token balance from " + to_string(db.safe(t.from).balance(db.safe(t.from).token)) +
+			" to " + to_string(db.safe(t.to).balance(db.safe(t.from).token)) +
+			" receiver token receiver balance " + to_string(db.safe(t.to).balance(db.safe(t.to).token)) +
 			"\n";
 	}
 	return out;
 }
 
-json flowJson(json const& _parameters)
+/// Flow request with the ids resolved against the database when it was received.
+struct FlowQuery
+{
+	optional<NodeId> from;
+	optional<NodeId> to;
+	Int value;
+	bool prune = false;
+	bool bounded = true;
+	FlowEngine engine = FlowEngine::EdmondsKarp;
+};
+
+FlowQuery flowQuery(json const& _parameters)
 {
-	Address from{string(_parameters["from"])};
-	Address to{string(_parameters["to"])};
-	Int value{string(_parameters["value"])};
-	bool prune = _parameters.contains("prune") && _parameters["prune"];
-#if USE_FLOW
-	auto [flow, transfers] = computeFlow(from, to, db.flowGraph(), value);
-#else
-	auto [flow, transfers] = computeFlow(from, to, db.edges(), value, prune);
-#endif
+	FlowQuery query;
+	query.from = db.idMaybe(Address{string(_parameters["from"])});
+	query.to = db.idMaybe(Address{string(_parameters["to"])});
+	query.value = Int{string(_parameters["value"])};
+	query.prune = _parameters.contains("prune") && _parameters["prune"];
+	query.bounded = !_parameters.contains("bounded") || _parameters["bounded"];
+	if (_parameters.contains("engine"))
+		query.engine = flowEngineFromName(_parameters["engine"]);
+	return query;
+}
 
+/// Computes the flow on @a _version without accessing the database.
+/// Nodes that are newer than @a _version do not have any edges in it.
+pair<Int, vector<Edge>> runFlow(FlowQuery const& _query, DBVersion const& _version)
+{
+	if (!_query.from || !_query.to)
+		return {};
+	return computeFlow(*_query.from, *_query.to, *_version.graph, _query.value, _query.prune, _query.engine, _query.bounded);
+}
+
+/// @returns the flow output, with the transfers formatted using @a _version only.
+json flowResultJson(Int const& _flow, vector<Edge> const& _transfers, DBVersion const& _version)
+{
 	json output;
-	output["flow"] = to_string(flow);
+	output["flow"] = to_string(_flow);
 	output["transfers"] = json::array();
-	for (Edge const& t: transfers)
+	for (Edge const& t: _transfers)
 		output["transfers"].push_back(json{
-			{"from", to_string(t.from)},
-			{"to", to_string(t.to)},
-			{"token", to_string(t.token)},
-			{"tokenOwner", to_string(db.token(t.token).safeAddress)},
+			{"from", _version.addressString(t.from)},
+			{"to", _version.addressString(t.to)},
+			{"token", _version.addressString(t.token)},
+			{"tokenOwner", _version.addressString(_version.tokenOwner(t.token))},
 			{"value", to_string(t.capacity)}
 		});
+	return output;
+}
+
+json flowJson(json const& _parameters)
+{
+	shared_ptr<DBVersion const> version = db.version();
+	auto [flow, transfers] = runFlow(flowQuery(_parameters), *version);
+	json output = flowResultJson(flow, transfers, *version);
 	output["debug"] = debugData(transfers);
 	return output;
 }
@@ -88,11 +311,13 @@ extern "C"
 {
 size_t loadDB(char const* _data, size_t _length)
 {
-	string data(_data, _length);
-	istringstream stream(data);
-	size_t blockNumber{};
-	tie(blockNumber, db) = BinaryImporter(stream).readBlockNumberAndDB();
-	return blockNumber;
+	tie(dbBlockNumber, db) = BinaryImporter(_data, _length).readBlockNumberAndDB();
+	return dbBlockNumber;
+}
+
+size_t loadDBDiff(char const* _data, size_t _length)
+{
+	return applyDiffToDB(_data, _length);
 }
 
 size_t edgeCount()
@@ -144,6 +369,22 @@ char const* adjacencies(char const* _user)
 	return retVal.c_str();
 }
 
+/// Applies the events given as JSON array, see the JSON command applyEvents.
+char const* applyEvents(char const* _input)
+{
+	static string retVal;
+	retVal = applyEventsJson(json::parse(string(_input))).dump();
+	return retVal.c_str();
+}
+
+/// Applies raw Ethereum logs, the input is the same as for the JSON command applyLogs.
+char const* applyLogs(char const* _input)
+{
+	static string retVal;
+	retVal = applyLogsJson(json::parse(string(_input))).dump();
+	return retVal.c_str();
+}
+
 char const* flow(char const* _input)
 {
 	static string retVal;
@@ -156,20 +397,41 @@ void computeFlow(
 	Address const& _source,
 	Address const& _sink,
 	Int const& _value,
-	string const& _dbDat
+	string const& _dbDat,
+	string const& _engine
 )
 {
-	ifstream stream(_dbDat);
-	size_t blockNumber{};
+	FlowEngine engine = flowEngineFromName(_engine);
+	MappedFile file(_dbDat);
+	optional<DBView> view;
 	DB db;
-	tie(blockNumber, db) = BinaryImporter(stream).readBlockNumberAndDB();
-	cerr << "Edges: " << db.m_edges.size() << endl;
-
-#if USE_FLOW
-	auto [flow, transfers] = computeFlow(_source, _sink, db.flowGraph(), _value);
-#else
-	auto [flow, transfers] = computeFlow(_source, _sink, db.edges(), _value);
-#endif
+	if (DBView::isDBFile(file.data(), file.size()))
+	{
+		// Use the precomputed edges in place, no need to build the DB.
+		view.emplace(file.data(), file.size());
+		if (!view->hasEdges())
+		{
+			db = view->toDB();
+			view.reset();
+		}
+	}
+	else
+		db = BinaryImporter(file.data(), file.size()).readBlockNumberAndDB().second;
+	auto idMaybe = [&](Address const& _address) { return view ? view->find(_address) : db.idMaybe(_address); };
+	auto address = [&](NodeId _id) -> Address const& { return view ? view->address(_id) : db.address(_id); };
+
+	optional<NodeId> source = idMaybe(_source);
+	optional<NodeId> sink = idMaybe(_sink);
+	Int flow;
+	vector<Edge> transfers;
+	if (source && sink)
+	{
+		optional<CSRGraph> graph;
+		if (view)
+			graph.emplace(view->edges());
+		cerr << "Edges: " << (view ? view->edges().size() : db.edges().size()) << endl;
+		tie(flow, transfers) = computeFlow(*source, *sink, view ? *graph : db.csrGraph(), _value, false, engine);
+	}
 //	cout << "Flow: " << flow << endl;
 //	cout << "Transfers: " << endl;
 //	for (Edge const& edge: transfers)
@@ -180,9 +442,9 @@ void computeFlow(
 	for (Edge const& transfer: transfers)
 		transfersJson.push_back(nlohmann::json{
 			{"step", stepNr++},
-			{"from", to_string(transfer.from)},
-			{"to", to_string(transfer.to)},
-			{"token", to_string(transfer.token)},
+			{"from", to_string(address(transfer.from))},
+			{"to", to_string(address(transfer.to))},
+			{"token", to_string(address(transfer.token))},
 			{"value", to_string(transfer.capacity)}
 		});
 	cout << json{
@@ -201,6 +463,7 @@ void computeFlowFromEdgesCSV(
 	cerr << "Importing csv..." << endl;
 	auto t1 = chrono::high_resolution_clock::now();
 	ifstream stream(_edgesCSV);
+	AddressInterner addresses;
 	set<Edge> edges;
 	string line;
 	while (getline(stream, line))
@@ -222,12 +485,23 @@ void computeFlowFromEdgesCSV(
 		if (parts[0] == "from")
 			// ignore header
 			continue;
-		edges.insert(Edge{Address{parts[0]}, Address{parts[1]}, Address{parts[2]}, Int{parts[3]}});
+		edges.insert(Edge{
+			addresses.intern(Address{parts[0]}),
+			addresses.intern(Address{parts[1]}),
+			addresses.intern(Address{parts[2]}),
+			Int{parts[3]}
+		});
 	}
 	auto t2 = chrono::high_resolution_clock::now();
 	cerr << "Took " << chrono::duration_cast<chrono::duration<double>>(t2 - t1).count() << endl;
 
-	auto [flow, transfers] = computeFlow(_source, _sink, edges, _value, true);
+	auto [flow, transfers] = computeFlow(
+		addresses.intern(_source),
+		addresses.intern(_sink),
+		CSRGraph(edges),
+		_value,
+		true
+	);
 //	cout << "Flow: " << flow << endl;
 //	cout << "Transfers: " << endl;
 //	for (Edge const& edge: transfers)
@@ -238,9 +512,9 @@ void computeFlowFromEdgesCSV(
 	for (Edge const& transfer: transfers)
 		transfersJson.push_back(nlohmann::json{
 			{"step", stepNr++},
-			{"from", to_string(transfer.from)},
-			{"to", to_string(transfer.to)},
-			{"token", to_string(transfer.token)},
+			{"from", addresses.addressString(transfer.from)},
+			{"to", addresses.addressString(transfer.to)},
+			{"token", addresses.addressString(transfer.token)},
 			{"value", to_string(transfer.capacity)}
 		});
 	cout << json{
@@ -254,6 +528,7 @@ void edgesCSVToBin(string const& _edgesCSV, string const& _edgesBin)
 	cerr << "Importing csv..." << endl;
 	auto t1 = chrono::high_resolution_clock::now();
 	ifstream stream(_edgesCSV);
+	AddressInterner addresses;
 	set<Edge> edges;
 	string line;
 	while (getline(stream, line))
@@ -271,33 +546,44 @@ void edgesCSVToBin(string const& _edgesCSV, string const& _edgesBin)
 		if (parts[0] == "from")
 			// ignore header
 			continue;
-		edges.insert(Edge{Address{parts[0]}, Address{parts[1]}, Address{parts[2]}, Int{parts[3]}});
+		edges.insert(Edge{
+			addresses.intern(Address{parts[0]}),
+			addresses.intern(Address{parts[1]}),
+			addresses.intern(Address{parts[2]}),
+			Int{parts[3]}
+		});
 	}
 	auto t2 = chrono::high_resolution_clock::now();
 	cerr << "Took " << chrono::duration_cast<chrono::duration<double>>(t2 - t1).count() << endl;
 	cerr << "Exporting dat..." << endl;
 
 	BinaryExporter exp(_edgesBin);
-	exp.write(edges);
+	exp.write(edges, addresses);
 	auto t3 = chrono::high_resolution_clock::now();
 	cerr << "Took " << chrono::duration_cast<chrono::duration<double>>(t3 - t2).count() << endl;
 }
 
-void importDB(string const& _safesJson, string const& _dbDat)
+void importDB(string const& _safesJson, string const& _dbDat, string const& _format)
 {
+	DBFormat format = dbFormatFromName(_format);
 	ifstream graph(_safesJson);
-	json safesJson;
-	graph >> safesJson;
+	require(graph);
+	DB db;
+	string blockNumberStr = db.importFromTheGraph(graph);
 	graph.close();
 
-	string blockNumberStr(safesJson["blockNumber"]);
 	size_t blockNumber(size_t(stoi(blockNumberStr, nullptr, 0)));
 	require(blockNumber > 0);
 	cerr << "Block number: " << blockNumber << endl;
 
-	DB db;
-	db.importFromTheGraph(safesJson["safes"]);
-	BinaryExporter(_dbDat).write(blockNumber, db);
+	BinaryExporter(_dbDat).write(blockNumber, db, format);
+}
+
+void convertDB(string const& _inDat, string const& _outDat, string const& _format)
+{
+	DBFormat format = dbFormatFromName(_format);
+	auto [blockNumber, db] = readDBFile(_inDat);
+	BinaryExporter(_outDat).write(blockNumber, db, format);
 }
 
 /*
@@ -310,143 +596,160 @@ void dbToEdges(string const& _dbDat, string const& _edgesDat)
 		_edgesDat
 	);
 }
+*/
 
-
-set<Edge> computeDiff(set<Edge> const& _oldEdges, set<Edge> const& _newEdges)
-{
-	set<Edge> diff;
-
-	auto itA = _oldEdges.begin();
-	auto itB = _newEdges.begin();
-
-	while (itA != _oldEdges.end() || itB != _newEdges.end())
-	{
-		if (itB == _newEdges.end() || *itA < *itB)
-		{
-			Edge removed(*itA);
-			removed.capacity = Int(0);
-			diff.insert(diff.end(), move(removed));
-			++itA;
-		}
-		else if (itA == _oldEdges.end() || *itB < *itA)
-		{
-			diff.insert(diff.end(), *itB);
-			++itB;
-		}
-		else
-		{
-			require(itA->from == itB->from && itA->to == itB->to && itA->token == itB->token);
-			if (itA->capacity != itB->capacity)
-				diff.insert(diff.end(), *itB);
-			++itA;
-			++itB;
-		}
-	}
-	return diff;
-}
-
-void computeDiff(string const& _oldEdges, string const& _newEdges, string const& _diff)
+void computeDiff(string const& _oldDat, string const& _newDat, string const& _diffDat)
 {
-	set<Edge> oldEdges = importEdges(_oldEdges);
-	cout << "Old edges: " << oldEdges.size() << endl;
-	set<Edge> newEdges = importEdges(_newEdges);
-	cout << "New edges: " << newEdges.size() << endl;
-	set<Edge> diff = computeDiff(oldEdges, newEdges);
-	cout << "Size of diff: " << diff.size() << endl;
-
-	edgeSetToBinary(diff, _diff);
+	auto [oldBlockNumber, oldDB] = readDBFile(_oldDat);
+	auto [newBlockNumber, newDB] = readDBFile(_newDat);
+	DBDiff diff = computeDiff(oldDB, oldBlockNumber, newDB, newBlockNumber);
+	cerr << "Diff: " << diff.changedSafes.size() << " changed and " << diff.removedSafes.size() << " removed safes." << endl;
+	BinaryExporter(_diffDat).write(diff);
 }
 
-set<Edge> applyDiff(set<Edge> const& _oldEdges, set<Edge> const& _diff)
+void applyDiff(string const& _oldDat, string const& _diffDat, string const& _outDat, string const& _format)
 {
-	set<Edge> newEdges;
-
-	auto itA = _oldEdges.begin();
-	auto itB = _diff.begin();
-
-	while (itA != _oldEdges.end() || itB != _diff.end())
-	{
-		if (itB == _diff.end() || *itA < *itB)
-		{
-			newEdges.insert(newEdges.end(), *itA);
-			++itA;
-		}
-		else if (itA == _oldEdges.end() || *itB < *itA)
-		{
-			newEdges.insert(newEdges.end(), *itB);
-			++itB;
-		}
-		else
-		{
-			require(itA->from == itB->from && itA->to == itB->to && itA->token == itB->token);
-			if (itB->capacity != Int(0))
-				newEdges.insert(*itB);
-			else
-				cout << "Skipping " << itB->from << endl;
-			++itA;
-			++itB;
-		}
-	}
-	return newEdges;
+	DBFormat format = dbFormatFromName(_format);
+	auto [blockNumber, db] = readDBFile(_oldDat);
+	MappedFile file(_diffDat);
+	DBDiff diff = BinaryImporter(file.data(), file.size()).readDBDiff();
+	require(diff.fromBlock == blockNumber);
+	db.applyDiff(diff);
+	BinaryExporter(_outDat).write(diff.toBlock, db, format);
 }
 
-
-void applyDiff(string const& _oldEdges, string const& _diff, string const& _newEdges)
+void jsonMode(size_t _threads)
 {
-	set<Edge> oldEdges = importEdges(_oldEdges);
-	cout << "Old edges: " << oldEdges.size() << endl;
-	set<Edge> diff = importEdges(_diff);
-	cout << "Diff: " << diff.size() << endl;
-	set<Edge> newEdges = applyDiff(oldEdges, diff);
-	cout << "New edges: " << newEdges.size() << endl;
-
-	edgeSetToBinary(newEdges, _newEdges);
-}
-*/
+	// Commands that change the database run on this thread in the order they are received,
+	// holding dbMutex exclusively. Read-only commands are prepared here and the rest of
+	// their work runs on the worker threads. Their responses are sent as soon as they are done.
+	// Flows run on the version that was published when they were received. This thread
+	// publishes a new version after each batch of updates, while in-flight flows keep a
+	// reference to theirs, so that the old version is freed with its last reader.
+	// Only the debug output and adjacencies read the safes and hold dbMutex shared.
+	// Edge updates do not change the safes, so performEdgeUpdates only holds it shared as well.
+	shared_mutex dbMutex;
+	shared_ptr<DBVersion const> publishedVersion;
+	// Number of commands that changed the database, protected by dbMutex, and its value
+	// when publishedVersion was published.
+	size_t generation = 0;
+	size_t publishedGeneration = 0;
+	auto publish = [&]() {
+		publishedVersion = db.version();
+		publishedGeneration = generation;
+	};
+	mutex outputMutex;
+	auto respond = [&](json _output, json const& _id) {
+		_output["id"] = _id;
+		lock_guard<mutex> lock(outputMutex);
+		cout << _output.dump() << endl;
+	};
 
-void jsonMode()
-{
 	map<string, function<json(json const&)>> functions{
 		{"loaddb", [](json const& _input) {
-			ifstream instream{string{_input["file"]}};
-			size_t blockNumber;
-			tie(blockNumber, db) = BinaryImporter(instream).readBlockNumberAndDB();
-			return json{{"blockNumber", blockNumber}};
+			journal.reset();
+			tie(dbBlockNumber, db) = readDBFile(string{_input["file"]});
+			return json{{"blockNumber", dbBlockNumber}};
 		}},
 		{"loaddbStream", [](json const& _input) {
+			journal.reset();
 			string data = fromHexStream(_input["data"]);
-			istringstream instream{data};
-			size_t blockNumber;
-			tie(blockNumber, db) = BinaryImporter(instream).readBlockNumberAndDB();
-			return json{{"blockNumber", blockNumber}};
+			tie(dbBlockNumber, db) = BinaryImporter(data.data(), data.size()).readBlockNumberAndDB();
+			return json{{"blockNumber", dbBlockNumber}};
+		}},
+		{"loaddbDiff", [](json const& _input) {
+			journal.reset();
+			// The diff is either given as file or as hex data, like the snapshot for loaddb and loaddbStream.
+			if (_input.contains("data"))
+			{
+				string data = fromHexStream(_input["data"]);
+				return json{{"blockNumber", applyDiffToDB(data.data(), data.size())}};
+			}
+			MappedFile file(string{_input["file"]});
+			return json{{"blockNumber", applyDiffToDB(file.data(), file.size())}};
+		}},
+		{"openJournal", [](json const& _input) {
+			// Restores the database from the journal if possible, otherwise
+			// starts a new journal with the loaded database.
+			size_t snapshotInterval = _input.contains("snapshotInterval") ? size_t(_input["snapshotInterval"]) : 10000;
+			journal = make_unique<Journal>(string{_input["directory"]}, snapshotInterval);
+			if (optional<JournalPosition> position = journal->restore(db))
+			{
+				dbBlockNumber = position->blockNumber;
+				return json{{"blockNumber", dbBlockNumber}, {"replayed", journal->replayedEvents()}};
+			}
+			if (dbBlockNumber == 0)
+			{
+				journal.reset();
+				return json{{"blockNumber", 0}};
+			}
+			journal->start(db, dbBlockNumber);
+			return json{{"blockNumber", dbBlockNumber}, {"replayed", 0}};
 		}},
 		{"dumpdb", [](json const& _input) {
-			BinaryExporter(string{_input["file"]}).write(size_t(_input["blockNumber"]), db);
+			DBFormat format = _input.contains("format") ? dbFormatFromName(_input["format"]) : DBFormat::V1;
+			BinaryExporter(string{_input["file"]}).write(size_t(_input["blockNumber"]), db, format);
 			return json{};
 		}},
 		{"exportJson", [](json const&) { return db.exportToJson(); }},
-		{"flow", [](json const& _input) { return flowJson(_input); }},
-		{"adjacencies", [](json const& _input) { return json{{"adjacencies", adjacenciesJson(_input["user"])}}; }},
-		{"edgeCount", [](json const&) { return json{{"edgeCount", db.edges().size()}}; }},
-		{"delayEdgeUpdates", [](json const&) { db.delayEdgeUpdates(); return json{}; }},
-		{"performEdgeUpdates", [](json const&) { db.performEdgeUpdates(); return json{}; }},
-		{"signup", [](json const& _input) {
-			db.signup(Address(_input["user"]), Address(_input["token"]));
-			return json{};
+		{"checkEdges", [](json const&) {
+			// Compares the incrementally updated edges to a full re-computation.
+			DB full = db;
+			full.computeEdges();
+			bool consistent = equal(
+				db.edges().begin(), db.edges().end(),
+				full.edges().begin(), full.edges().end(),
+				[](Edge const& _a, Edge const& _b) { return !(_a < _b) && !(_b < _a) && _a.capacity == _b.capacity; }
+			);
+			return json{{"edgeCount", db.edges().size()}, {"consistent", consistent}};
 		}},
-		{"organizationSignup", [](json const& _input) {
-			db.organizationSignup(Address(_input["organization"]));
-			return json{};
+		{"delayEdgeUpdates", [](json const&) { db.delayEdgeUpdates(); return json{}; }},
+		{"applyEvents", [](json const& _input) { return applyEventsJson(_input["events"]); }},
+		{"applyLogs", applyLogsJson}
+	};
+	for (char const* type: {"signup", "organizationSignup", "trust", "transfer"})
+		functions[type] = [type = string(type)](json const& _input) {
+			return processEvent(positionFromJson(_input), eventFromJson(type, _input)) ? json{} : json{{"skipped", true}};
+		};
+
+	// Read-only commands: They are resolved against the current database here
+	// and @return the remaining work.
+	map<string, function<function<json()>(json const&)>> queries{
+		{"flow", [&](json const& _input) -> function<json()> {
+			return [&, query = flowQuery(_input), version = publishedVersion, versionGeneration = publishedGeneration]() {
+				auto [flow, transfers] = runFlow(query, *version);
+				json output = flowResultJson(flow, transfers, *version);
+				// The debug output reads the safes, which only belong to the node ids
+				// of the version if the database has not changed since it was published.
+				shared_lock<shared_mutex> lock(dbMutex);
+				if (generation == versionGeneration)
+					output["debug"] = debugData(transfers);
+				return output;
+			};
 		}},
-		{"trust", [](json const& _input) {
-			db.trust(Address(_input["canSendTo"]), Address(_input["user"]), uint32_t(_input["limitPercentage"]));
-			return json{};
+		{"adjacencies", [&](json const& _input) -> function<json()> {
+			return [&, user = string(_input["user"])]() {
+				shared_lock<shared_mutex> lock(dbMutex);
+				return json{{"adjacencies", adjacenciesJson(user)}};
+			};
 		}},
-		{"transfer", [](json const& _input) {
-			db.transfer(Address(_input["token"]), Address(_input["from"]), Address(_input["to"]), Int(string(_input["value"])));
-			return json{};
+		{"edgeCount", [&](json const&) -> function<json()> {
+			return [edgeCount = publishedVersion->edgeCount]() { return json{{"edgeCount", edgeCount}}; };
 		}}
 	};
+	auto run = [](auto const& _function) {
+		try
+		{
+			return _function();
+		}
+		catch (...)
+		{
+			return json{{"error", "Exception occurred."}};
+		}
+	};
+
+	// Declared last, so that it finishes the queued queries before the rest is destroyed.
+	WorkerPool workers(_threads);
 	while (std::cin)
 	{
 		string line;
@@ -456,58 +759,93 @@ void jsonMode()
 		json input = json::parse(line);
 		string cmd = input["cmd"];
 		json id = input["id"];
-		json output;
-		if (functions.count(cmd))
+		if (queries.count(cmd))
 		{
-			try
-			{
-				output = functions.at(cmd)(input);
-			}
-			catch (...)
-			{
-				output = json{{"error", "Exception occurred."}};
-			}
+			// While edge updates are delayed, the queries keep using the last version, since
+			// the edges are not updated anyway.
+			if (!publishedVersion || !db.m_delayEdgeUpdates)
+				publish();
+			// This is the only thread that changes the database, so it can read it without lock.
+			function<json()> query;
+			json output = run([&]() { query = queries.at(cmd)(input); return json{}; });
+			if (!query)
+				respond(move(output), id);
+			else if (_threads == 0)
+				respond(run(query), id);
+			else
+				workers.enqueue([&, query = move(query), id]() { respond(run(query), id); });
+		}
+		else if (cmd == "performEdgeUpdates")
+		{
+			shared_lock<shared_mutex> lock(dbMutex);
+			json output = run([&]() {
+				db.performEdgeUpdates();
+				if (journal)
+					journal->snapshotIfDue(db);
+				publish();
+				return json{};
+			});
+			lock.unlock();
+			respond(move(output), id);
+		}
+		else if (functions.count(cmd))
+		{
+			unique_lock<shared_mutex> lock(dbMutex);
+			generation++;
+			json output = run([&]() { return functions.at(cmd)(input); });
+			lock.unlock();
+			respond(move(output), id);
 		}
 		else
-			output = json{{"error", "Command not found."}};
-		output["id"] = id;
-		cout << output.dump() << endl;
+			respond(json{{"error", "Command not found."}}, id);
 	}
 }
 
 int main(int argc, char const** argv)
 {
-	if (argc == 4 && argv[1] == string{"--importDB"})
-		importDB(argv[2], argv[3]);
-	else if (argc == 2 && argv[1] == string{"--json"})
-		jsonMode();
+	if ((argc == 4 || argc == 5) && argv[1] == string{"--importDB"})
+		importDB(argv[2], argv[3], argc == 5 ? argv[4] : "v1");
+	else if (argc == 5 && argv[1] == string{"--convertDB"})
+		convertDB(argv[2], argv[3], argv[4]);
+	else if ((argc == 2 || argc == 3) && argv[1] == string{"--json"})
+		jsonMode(argc == 3 ? size_t(stoi(argv[2])) : threadCount());
 //	else if (argc == 4 && argv[1] == string{"--dbToEdges"})
 //		dbToEdges(argv[2], argv[3]);
-//	else if (argc == 5 && argv[1] == string{"--computeDiff"})
-//		computeDiff(argv[2], argv[3], argv[4]);
-//	else if (argc == 5 && argv[1] == string{"--applyDiff"})
-//		applyDiff(argv[2], argv[3], argv[4]);
+	else if (argc == 5 && argv[1] == string{"--computeDiff"})
+		computeDiff(argv[2], argv[3], argv[4]);
+	else if ((argc == 5 || argc == 6) && argv[1] == string{"--applyDiff"})
+		applyDiff(argv[2], argv[3], argv[4], argc == 6 ? argv[5] : "v1");
 	else if (argc == 6 && argv[1] == string{"--flowcsv"})
 		computeFlowFromEdgesCSV(Address(string(argv[2])), Address(string(argv[3])), Int(string(argv[4])), argv[5]);
 	else if (argc == 4 && argv[1] == string{"--edgesCSVToBin"})
 		edgesCSVToBin(argv[2], argv[3]);
-	else if (
-		(argc == 6 && argv[1] == string{"--flow"}) ||
-		(argc == 5 && string(argv[1]).substr(0, 2) != "--")
-	)
-		computeFlow(Address(string(argv[1])), Address(string(argv[2])), Int(string(argv[3])), argv[4]);
+	else if ((argc == 6 || argc == 7) && argv[1] == string{"--flow"})
+		computeFlow(
+			Address(string(argv[2])),
+			Address(string(argv[3])),
+			Int(string(argv[4])),
+			argv[5],
+			argc == 7 ? argv[6] : "edmondsKarp"
+		);
+	else if (argc == 5 && string(argv[1]).substr(0, 2) != "--")
+		computeFlow(Address(string(argv[1])), Address(string(argv[2])), Int(string(argv[3])), argv[4], "edmondsKarp");
 	else
 	{
 		cerr << "Usage: " << argv[0] << " <from> <to> <value> <edges.dat>" << endl;
 		cerr << "Options: " << endl;
-		cerr << "  --json                                     JSON mode via stdin/stdout." << endl;
+		cerr << "  --json [<threads>]                         JSON mode via stdin/stdout." << endl;
+		cerr << "                                             Read-only commands run on <threads> threads (default: one per core)," << endl;
+		cerr << "                                             0 answers all commands in order." << endl;
 		cerr << "  --flowcsv <from> <to> <value> <edges.csv>  Compute max flow up to <value> from edges csv and output transfer steps in json." << endl;
 		cerr << "  --edgesCSVToBin <edges.csv> <edges.dat>    Convert edges csv to binray." << endl;
-		cerr << "  [--flow] <from> <to> <value> <db.dat>      Compute max flow up to <value> and output transfer steps in json." << endl;
-		cerr << "  --importDB <safes.json> <db.dat>           Import safes with trust edges and generate transfer limit graph." << endl;
+		cerr << "  [--flow] <from> <to> <value> <db.dat> [<engine>]  Compute max flow up to <value> and output transfer steps in json." << endl;
+		cerr << "                                                    <engine> is edmondsKarp (default), dinic or pushRelabel." << endl;
+		cerr << "  --importDB <safes.json> <db.dat> [<format>]  Import safes with trust edges and generate transfer limit graph." << endl;
+		cerr << "                                               <format> is v1 (default), v1edges (v1 with edges), v2 (memory-mappable) or v3 (compact)." << endl;
+		cerr << "  --convertDB <in.dat> <out.dat> <format>    Convert a db.dat file to the given format." << endl;
 		cerr << "  --dbToEdges <db.dat> <edges.dat>           Import safes with trust edges and generate transfer limit graph." << endl;
-		cerr << "  --computeDiff <old.dat> <new.dat> <diff.dat>  Compute a difference file." << endl;
-		cerr << "  --applyDiff <old.dat> <diff.dat> <out.dat>    Apply a previously computed difference file." << endl;
+		cerr << "  --computeDiff <old.dat> <new.dat> <diff.dat>  Compute the changes of the safes between two db.dat files." << endl;
+		cerr << "  --applyDiff <old.dat> <diff.dat> <out.dat> [<format>]  Apply a previously computed difference file." << endl;
 		cerr << "  [--help]                                      This help screen." << endl;
 		return 1;
 	}
@@ -0,0 +1,34 @@
+#include "mappedFile.h"
+
+#include "exceptions.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile::MappedFile(string const& _path)
+{
+	int fd = open(_path.c_str(), O_RDONLY);
+	require(fd >= 0);
+	struct stat info{};
+	if (fstat(fd, &info) != 0)
+	{
+		close(fd);
+		require(false);
+	}
+	m_size = size_t(info.st_size);
+	void* data = m_size > 0 ? mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+	// The mapping stays valid after closing the descriptor.
+	close(fd);
+	require(data != MAP_FAILED);
+	m_data = static_cast<char const*>(data);
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data)
+		munmap(const_cast<char*>(m_data), m_size);
+}
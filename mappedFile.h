@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+/// Read-only memory mapping of a whole file.
+/// Throws if the file cannot be opened or mapped.
+class MappedFile
+{
+public:
+	explicit MappedFile(std::string const& _path);
+	~MappedFile();
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+
+	char const* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	char const* m_data = nullptr;
+	size_t m_size = 0;
+};
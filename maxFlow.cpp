@@ -0,0 +1,501 @@
+#include "maxFlow.h"
+
+#include "csrGraph.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+
+size_t constexpr NoArc = numeric_limits<size_t>::max();
+size_t constexpr Unreached = numeric_limits<size_t>::max();
+
+size_t tail(CSRGraph const& _graph, size_t _arc)
+{
+	return _graph.target(_graph.reverse(_arc));
+}
+
+/// Breadth-first search for a shortest path with positive residual capacity.
+/// @returns the bottleneck capacity of the path (zero if there is none) and fills
+/// @a _parentArc with the arc used to reach each node on the path.
+/// @a _queue is scratch space that is reused across calls, it has to be empty
+/// on the first call and @a _parentArc has to be all NoArc.
+Int augmentingPath(
+	size_t _source,
+	size_t _sink,
+	CSRGraph const& _graph,
+	vector<Int> const& _residual,
+	vector<size_t>& _parentArc,
+	vector<size_t>& _queue
+)
+{
+	// Only reset the nodes visited by the previous search.
+	for (size_t node: _queue)
+		_parentArc[node] = NoArc;
+	_parentArc[_sink] = NoArc;
+	_queue.assign(1, _source);
+	for (size_t head = 0; head < _queue.size(); ++head)
+	{
+		size_t node = _queue[head];
+		for (size_t arc = _graph.arcsBegin(node); arc != _graph.arcsEnd(node); ++arc)
+		{
+			size_t target = _graph.target(arc);
+			if (target == _source || _parentArc[target] != NoArc || _residual[arc] == Int(0))
+				continue;
+			_parentArc[target] = arc;
+			if (target == _sink)
+			{
+				Int bottleneck = Int::max();
+				for (size_t n = _sink; n != _source; n = tail(_graph, _parentArc[n]))
+					bottleneck = min(bottleneck, _residual[_parentArc[n]]);
+				return bottleneck;
+			}
+			_queue.push_back(target);
+		}
+	}
+	return Int(0);
+}
+
+/// Computes the BFS distance from @a _source in the residual graph for all nodes
+/// not further away than @a _sink.
+/// @returns false if the sink is not reachable.
+bool levelGraph(
+	size_t _source,
+	size_t _sink,
+	CSRGraph const& _graph,
+	vector<Int> const& _residual,
+	vector<size_t>& _level,
+	vector<size_t>& _queue
+)
+{
+	fill(_level.begin(), _level.end(), Unreached);
+	_level[_source] = 0;
+	_queue.assign(1, _source);
+	for (size_t head = 0; head < _queue.size(); ++head)
+	{
+		size_t node = _queue[head];
+		if (_level[_sink] != Unreached && _level[node] >= _level[_sink])
+			break;
+		for (size_t arc = _graph.arcsBegin(node); arc != _graph.arcsEnd(node); ++arc)
+		{
+			size_t target = _graph.target(arc);
+			if (_level[target] == Unreached && _residual[arc] != Int(0))
+			{
+				_level[target] = _level[node] + 1;
+				_queue.push_back(target);
+			}
+		}
+	}
+	return _level[_sink] != Unreached;
+}
+
+/// State of the push-relabel algorithm. Nodes are kept in doubly linked
+/// lists per label (needed for the gap heuristic) and active nodes additionally
+/// in singly linked lists per label, so that the highest active label can be found quickly.
+class PushRelabel
+{
+public:
+	PushRelabel(CSRGraph const& _graph, vector<Int>& _residual):
+		m_graph(_graph),
+		m_residual(_residual),
+		m_nodes(_graph.nodeCount()),
+		m_excess(m_nodes),
+		m_label(m_nodes, m_nodes),
+		m_currentArc(m_nodes),
+		m_next(m_nodes, None),
+		m_previous(m_nodes, None),
+		m_nextActive(m_nodes, None),
+		m_bucket(m_nodes + 1, None),
+		m_activeBucket(m_nodes + 1, None)
+	{}
+
+	/// Pushes as much of the excess as possible to @a _target and
+	/// leaves the rest at nodes from which @a _target cannot be reached.
+	/// @a _fixed is never activated nor relabeled.
+	void run(size_t _target, size_t _fixed);
+
+	Int& excess(size_t _node) { return m_excess[_node]; }
+	/// Pushes @a _amount along @a _arc, taken by value since it might alias a residual capacity.
+	void push(size_t _arc, Int _amount);
+
+	static size_t constexpr None = numeric_limits<size_t>::max();
+
+private:
+	/// Sets all labels to the exact residual distance to m_target.
+	void globalRelabel();
+	void discharge(size_t _node);
+	/// Lifts all nodes with a label above @a _label to m_nodes.
+	void gap(size_t _label);
+
+	void setLabel(size_t _node, size_t _label);
+	void activate(size_t _node);
+	bool isActive(size_t _node) const
+	{
+		return _node != m_target && _node != m_fixed && m_label[_node] < m_nodes && m_excess[_node] != Int(0);
+	}
+
+	CSRGraph const& m_graph;
+	vector<Int>& m_residual;
+	size_t m_nodes;
+	size_t m_target = None;
+	size_t m_fixed = None;
+	vector<Int> m_excess;
+	vector<size_t> m_label;
+	vector<size_t> m_currentArc;
+	vector<size_t> m_next;
+	vector<size_t> m_previous;
+	vector<size_t> m_nextActive;
+	/// Head of the list of nodes with a given label.
+	vector<size_t> m_bucket;
+	/// Head of the list of active nodes with a given label.
+	vector<size_t> m_activeBucket;
+	/// Upper bound on the highest label of an active node.
+	size_t m_highestActive = 0;
+	/// Highest label of any node below m_nodes.
+	size_t m_highestLabel = 0;
+	/// Work done since the last global relabeling.
+	size_t m_work = 0;
+	vector<size_t> m_queue;
+};
+
+void PushRelabel::run(size_t _target, size_t _fixed)
+{
+	m_target = _target;
+	m_fixed = _fixed;
+	globalRelabel();
+	while (true)
+	{
+		while (m_highestActive > 0 && m_activeBucket[m_highestActive] == None)
+			m_highestActive--;
+		size_t node = m_activeBucket[m_highestActive];
+		if (node == None)
+			break;
+		m_activeBucket[m_highestActive] = m_nextActive[node];
+		m_nextActive[node] = None;
+		if (!isActive(node) || m_label[node] != m_highestActive)
+			continue;
+		discharge(node);
+		// Global relabeling after work linear in the size of the graph.
+		if (m_work > 6 * m_nodes + m_graph.arcCount())
+			globalRelabel();
+	}
+}
+
+void PushRelabel::push(size_t _arc, Int _amount)
+{
+	size_t target = m_graph.target(_arc);
+	m_residual[_arc] -= _amount;
+	m_residual[m_graph.reverse(_arc)] += _amount;
+	m_excess[tail(m_graph, _arc)] -= _amount;
+	bool wasActive = isActive(target);
+	m_excess[target] += _amount;
+	if (!wasActive && isActive(target))
+		activate(target);
+}
+
+void PushRelabel::globalRelabel()
+{
+	m_work = 0;
+	fill(m_label.begin(), m_label.end(), m_nodes);
+	fill(m_bucket.begin(), m_bucket.end(), None);
+	fill(m_activeBucket.begin(), m_activeBucket.end(), None);
+	fill(m_nextActive.begin(), m_nextActive.end(), None);
+	m_highestActive = 0;
+	m_highestLabel = 0;
+
+	// Backwards BFS from the target along arcs with residual capacity.
+	m_queue.assign(1, m_target);
+	setLabel(m_target, 0);
+	for (size_t head = 0; head < m_queue.size(); ++head)
+	{
+		size_t node = m_queue[head];
+		for (size_t arc = m_graph.arcsBegin(node); arc != m_graph.arcsEnd(node); ++arc)
+		{
+			size_t source = m_graph.target(arc);
+			if (
+				source != m_fixed &&
+				m_label[source] == m_nodes &&
+				m_residual[m_graph.reverse(arc)] != Int(0)
+			)
+			{
+				setLabel(source, m_label[node] + 1);
+				m_queue.push_back(source);
+			}
+		}
+	}
+	for (size_t node: m_queue)
+	{
+		m_currentArc[node] = m_graph.arcsBegin(node);
+		if (isActive(node))
+			activate(node);
+	}
+}
+
+void PushRelabel::discharge(size_t _node)
+{
+	while (m_excess[_node] != Int(0))
+	{
+		size_t& arc = m_currentArc[_node];
+		for (; arc != m_graph.arcsEnd(_node); ++arc)
+		{
+			size_t target = m_graph.target(arc);
+			if (m_residual[arc] != Int(0) && m_label[_node] == m_label[target] + 1)
+			{
+				push(arc, min(m_excess[_node], m_residual[arc]));
+				if (m_excess[_node] == Int(0))
+					return;
+			}
+		}
+
+		// Relabel.
+		size_t oldLabel = m_label[_node];
+		size_t newLabel = m_nodes;
+		for (size_t a = m_graph.arcsBegin(_node); a != m_graph.arcsEnd(_node); ++a)
+			if (m_residual[a] != Int(0))
+				newLabel = min(newLabel, m_label[m_graph.target(a)] + 1);
+		m_work += 12 + m_graph.arcsEnd(_node) - m_graph.arcsBegin(_node);
+		m_currentArc[_node] = m_graph.arcsBegin(_node);
+		// The node is the only one with its label: Nothing above it can reach the target.
+		bool isGap = m_bucket[oldLabel] == _node && m_next[_node] == None;
+		setLabel(_node, newLabel);
+		if (isGap)
+		{
+			gap(oldLabel);
+			return;
+		}
+		if (newLabel >= m_nodes)
+			return;
+	}
+}
+
+void PushRelabel::gap(size_t _label)
+{
+	for (size_t label = _label + 1; label <= m_highestLabel; ++label)
+	{
+		while (m_bucket[label] != None)
+			setLabel(m_bucket[label], m_nodes);
+		m_activeBucket[label] = None;
+	}
+	m_highestLabel = _label > 0 ? _label - 1 : 0;
+	m_highestActive = min(m_highestActive, m_highestLabel);
+}
+
+void PushRelabel::setLabel(size_t _node, size_t _label)
+{
+	size_t oldLabel = m_label[_node];
+	if (oldLabel < m_nodes)
+	{
+		// Unlink from the old bucket.
+		if (m_previous[_node] != None)
+			m_next[m_previous[_node]] = m_next[_node];
+		else
+			m_bucket[oldLabel] = m_next[_node];
+		if (m_next[_node] != None)
+			m_previous[m_next[_node]] = m_previous[_node];
+	}
+	m_next[_node] = None;
+	m_previous[_node] = None;
+	m_label[_node] = min(_label, m_nodes);
+	if (_label < m_nodes)
+	{
+		m_next[_node] = m_bucket[_label];
+		if (m_next[_node] != None)
+			m_previous[m_next[_node]] = _node;
+		m_bucket[_label] = _node;
+		m_highestLabel = max(m_highestLabel, _label);
+	}
+}
+
+void PushRelabel::activate(size_t _node)
+{
+	size_t label = m_label[_node];
+	m_nextActive[_node] = m_activeBucket[label];
+	m_activeBucket[label] = _node;
+	m_highestActive = max(m_highestActive, label);
+}
+
+}
+
+Int edmondsKarp(CSRGraph const& _graph, vector<Int>& _residual, size_t _source, size_t _sink, Int _limit)
+{
+	if (_source == _sink)
+		return Int(0);
+
+	vector<size_t> parentArc(_graph.nodeCount(), NoArc);
+	vector<size_t> queue;
+	Int flow{0};
+	while (flow < _limit)
+	{
+		Int newFlow = min(augmentingPath(_source, _sink, _graph, _residual, parentArc, queue), _limit - flow);
+		if (newFlow == Int(0))
+			break;
+		flow += newFlow;
+		for (size_t node = _sink; node != _source; node = tail(_graph, parentArc[node]))
+		{
+			size_t arc = parentArc[node];
+			_residual[arc] -= newFlow;
+			_residual[_graph.reverse(arc)] += newFlow;
+		}
+	}
+	return flow;
+}
+
+Int dinic(CSRGraph const& _graph, vector<Int>& _residual, size_t _source, size_t _sink, Int _limit)
+{
+	if (_source == _sink)
+		return Int(0);
+
+	vector<size_t> level(_graph.nodeCount());
+	vector<size_t> currentArc(_graph.nodeCount());
+	vector<size_t> queue;
+	vector<size_t> path;
+	Int flow{0};
+	while (flow < _limit && levelGraph(_source, _sink, _graph, _residual, level, queue))
+	{
+		for (size_t node: queue)
+			currentArc[node] = _graph.arcsBegin(node);
+
+		// Iterative DFS along the level graph. Arcs are only skipped once they
+		// cannot be used anymore in this phase, which makes the blocking flow linear
+		// in the number of arcs plus the total length of the augmenting paths.
+		size_t node = _source;
+		path.clear();
+		while (true)
+		{
+			if (node == _sink)
+			{
+				Int bottleneck = _limit - flow;
+				for (size_t arc: path)
+					bottleneck = min(bottleneck, _residual[arc]);
+				for (size_t arc: path)
+				{
+					_residual[arc] -= bottleneck;
+					_residual[_graph.reverse(arc)] += bottleneck;
+				}
+				flow += bottleneck;
+				if (flow == _limit)
+					return flow;
+				// Retreat to the tail of the first saturated arc.
+				size_t saturated = 0;
+				while (_residual[path[saturated]] != Int(0))
+					saturated++;
+				node = tail(_graph, path[saturated]);
+				path.resize(saturated);
+				continue;
+			}
+
+			size_t& arc = currentArc[node];
+			for (; arc != _graph.arcsEnd(node); ++arc)
+			{
+				size_t target = _graph.target(arc);
+				if (_residual[arc] != Int(0) && level[target] == level[node] + 1 && level[target] <= level[_sink])
+					break;
+			}
+			if (arc != _graph.arcsEnd(node))
+			{
+				path.push_back(arc);
+				node = _graph.target(arc);
+			}
+			else
+			{
+				// Dead end, remove the node from the level graph.
+				level[node] = Unreached;
+				if (node == _source)
+					break;
+				node = tail(_graph, path.back());
+				path.pop_back();
+				++currentArc[node];
+			}
+		}
+	}
+	return flow;
+}
+
+Int pushRelabel(CSRGraph const& _graph, vector<Int>& _residual, size_t _source, size_t _sink, Int _limit)
+{
+	if (_source == _sink)
+		return Int(0);
+
+	PushRelabel state(_graph, _residual);
+	// The source behaves like a regular node that starts with an excess of
+	// _limit, as if it was fed by a virtual super-source with an arc of that capacity.
+	// Whatever it cannot push towards the sink just stays there.
+	state.excess(_source) = _limit;
+	// Phase one: maximum preflow.
+	state.run(_sink, PushRelabel::None);
+	// Phase two: return the excess of nodes that are cut off from the sink.
+	state.run(_source, _sink);
+	return state.excess(_sink);
+}
+
+void cancelFlowCycles(CSRGraph const& _graph, vector<Int>& _residual)
+{
+	auto hasFlow = [&](size_t _arc) { return _residual[_arc] < _graph.capacities()[_arc]; };
+	enum class State { Unvisited, OnPath, Done };
+	vector<State> state(_graph.nodeCount(), State::Unvisited);
+	vector<size_t> currentArc(_graph.nodeCount());
+	// Position in the path of the arc leaving a node on the path.
+	vector<size_t> depth(_graph.nodeCount());
+	vector<size_t> path;
+
+	for (size_t root = 0; root < _graph.nodeCount(); ++root)
+	{
+		if (state[root] != State::Unvisited)
+			continue;
+		size_t node = root;
+		state[node] = State::OnPath;
+		currentArc[node] = _graph.arcsBegin(node);
+		depth[node] = 0;
+		path.clear();
+		while (true)
+		{
+			size_t& arc = currentArc[node];
+			for (; arc != _graph.arcsEnd(node); ++arc)
+				if (hasFlow(arc) && state[_graph.target(arc)] != State::Done)
+					break;
+			if (arc == _graph.arcsEnd(node))
+			{
+				state[node] = State::Done;
+				if (path.empty())
+					break;
+				node = tail(_graph, path.back());
+				path.pop_back();
+				++currentArc[node];
+				continue;
+			}
+			size_t target = _graph.target(arc);
+			path.push_back(arc);
+			if (state[target] == State::Unvisited)
+			{
+				state[target] = State::OnPath;
+				currentArc[target] = _graph.arcsBegin(target);
+				depth[target] = path.size();
+				node = target;
+				continue;
+			}
+
+			// Found a cycle starting and ending at target.
+			size_t start = depth[target];
+			Int amount = Int::max();
+			for (size_t i = start; i < path.size(); ++i)
+				amount = min(amount, _graph.capacities()[path[i]] - _residual[path[i]]);
+			for (size_t i = start; i < path.size(); ++i)
+			{
+				_residual[path[i]] += amount;
+				_residual[_graph.reverse(path[i])] -= amount;
+			}
+			// Continue at the tail of the first arc without flow, the nodes after it
+			// are not on the path anymore.
+			size_t firstEmpty = start;
+			while (hasFlow(path[firstEmpty]))
+				firstEmpty++;
+			for (size_t i = firstEmpty + 1; i < path.size(); ++i)
+				state[tail(_graph, path[i])] = State::Unvisited;
+			node = tail(_graph, path[firstEmpty]);
+			path.resize(firstEmpty);
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "types.h"
+
+#include <vector>
+
+class CSRGraph;
+
+/// Max-flow engines on a CSRGraph. Each of them starts from the given residual
+/// capacities, updates them in place and returns the value of the flow it added.
+/// They stop as soon as the flow reaches @a _limit.
+
+/// Edmonds-Karp: repeatedly augments along a shortest path found by BFS.
+Int edmondsKarp(CSRGraph const& _graph, std::vector<Int>& _residual, size_t _source, size_t _sink, Int _limit = Int::max());
+
+/// Dinic: builds a BFS level graph and saturates it with a blocking flow
+/// found by DFS with current-arc pointers, until the sink is unreachable.
+Int dinic(CSRGraph const& _graph, std::vector<Int>& _residual, size_t _source, size_t _sink, Int _limit = Int::max());
+
+/// Highest-label push-relabel with the gap and global relabeling heuristics.
+/// The first phase computes a maximum preflow, the second one returns the
+/// excess that cannot reach the sink to the source, so that the result is a flow.
+Int pushRelabel(CSRGraph const& _graph, std::vector<Int>& _residual, size_t _source, size_t _sink, Int _limit = Int::max());
+
+/// Cancels all cycles in the flow given by the residual capacities, so that
+/// the arcs with positive flow form an acyclic graph. Does not change the flow value.
+void cancelFlowCycles(CSRGraph const& _graph, std::vector<Int>& _residual);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+/// @returns the number of threads to use for work that can be split, at least one.
+inline size_t threadCount()
+{
+#ifdef __EMSCRIPTEN__
+	return 1;
+#else
+	return std::max<size_t>(1, std::thread::hardware_concurrency());
+#endif
+}
+
+/// Splits [0, _count) into one contiguous range per thread and calls
+/// @a _body(begin, end) for each range on its own thread.
+/// @returns the results of @a _body in the order of the ranges, so that they
+/// do not depend on the number of threads or their scheduling.
+/// The first exception thrown by @a _body is re-thrown once all threads are done.
+template <class F>
+auto parallelChunks(size_t _count, F const& _body) -> std::vector<decltype(_body(size_t{}, size_t{}))>
+{
+	size_t chunks = std::max<size_t>(1, std::min(threadCount(), _count));
+	std::vector<decltype(_body(size_t{}, size_t{}))> results(chunks);
+	std::vector<std::exception_ptr> errors(chunks);
+	auto run = [&](size_t _chunk) {
+		try
+		{
+			results[_chunk] = _body(_count * _chunk / chunks, _count * (_chunk + 1) / chunks);
+		}
+		catch (...)
+		{
+			errors[_chunk] = std::current_exception();
+		}
+	};
+	std::vector<std::thread> threads;
+	for (size_t chunk = 1; chunk < chunks; ++chunk)
+		threads.emplace_back(run, chunk);
+	run(0);
+	for (std::thread& thread: threads)
+		thread.join();
+	for (std::exception_ptr const& error: errors)
+		if (error)
+			std::rethrow_exception(error);
+	return results;
+}
@@ -63,10 +63,16 @@ if (stream)
     pathfinder = {
         loadDB: async (file) => { return (await callJson('loaddb', {file: file})).blockNumber; },
         loadDBStream: async (data) => { return (await callJson('loaddbStream', {data: data.toString('hex')})).blockNumber; },
-        signup: async (user, token) => { await callJson('signup', {user: user, token: token}); },
-        organizationSignup: async (organization) => { await callJson('organizationSignup', {organization: organization}); },
-        trust: async (canSendTo, user, limitPercentage) => { await callJson('trust', {canSendTo: canSendTo, user: user, limitPercentage: limitPercentage}); },
-        transfer: async (token, from, to, value) => { await callJson('transfer', {token: token, from: from, to: to, value: value}); },
+        loadDBDiff: async (data) => { return (await callJson('loaddbDiff', {data: data.toString('hex')})).blockNumber; },
+        openJournal: async (directory) => { return (await callJson('openJournal', {directory: directory})).blockNumber; },
+        // The optional position ({blockNumber, logIndex}) lets the journal skip events it already has.
+        signup: async (user, token, position) => { await callJson('signup', {user: user, token: token, ...position}); },
+        organizationSignup: async (organization, position) => { await callJson('organizationSignup', {organization: organization, ...position}); },
+        trust: async (canSendTo, user, limitPercentage, position) => { await callJson('trust', {canSendTo: canSendTo, user: user, limitPercentage: limitPercentage, ...position}); },
+        transfer: async (token, from, to, value, position) => { await callJson('transfer', {token: token, from: from, to: to, value: value, ...position}); },
+        applyEvents: async (events) => { return await callJson('applyEvents', {events: events}); },
+        // Raw logs as returned by getLogs, hub events are only accepted from the given hub contract.
+        applyLogs: async (logs, hub) => { return await callJson('applyLogs', {logs: logs, hub: hub}); },
         edgeCount: async () => { return (await callJson('edgeCount', {})).edgeCount; },
         delayEdgeUpdates: async () => { await callJson('delayEdgeUpdates', {}); },
         performEdgeUpdates: async () => { await callJson('performEdgeUpdates', {}); },
@@ -88,6 +94,8 @@ else
         organizationSignup: pathfinder_.cwrap("organizationSignup", null, ['string']),
         trust: pathfinder_.cwrap("trust", null, ['string', 'string', 'number']),
         transfer: pathfinder_.cwrap("transfer", null, ['string', 'string', 'string', 'string']),
+        applyEvents: (events) => JSON.parse(pathfinder_.ccall("applyEvents", 'string', ['string'], [JSON.stringify(events)])),
+        applyLogs: (logs, hub) => JSON.parse(pathfinder_.ccall("applyLogs", 'string', ['string'], [JSON.stringify({logs: logs, hub: hub})])),
         edgeCount: pathfinder_.cwrap("edgeCount", 'number', []),
         delayEdgeUpdates: pathfinder_.cwrap("delayEdgeUpdates", null, []),
         performEdgeUpdates: pathfinder_.cwrap("performEdgeUpdates", null, []),
@@ -123,6 +131,10 @@ let latestUpdate = 0;
 let update = function() { latestUpdate = +new Date(); };
 update();
 
+let logPosition = function(log) {
+    return {blockNumber: log.blockNumber, logIndex: log.logIndex};
+};
+
 let uintToAddress = function(value) {
     if (value.length != 66 || value.substr(0, 26) != "0x000000000000000000000000")
         throw("invalid address: " + value);
@@ -165,45 +177,15 @@ let updateSinceBlock = async function(lastKnownBlock) {
         topics: [[signupID, organizationSignupID, trustID]]
     });
     console.log("Number of events from hub to process: " + res.length)
-    let successNr = 0;
-    for (log of res) {
-        try {
-            if (log.topics[0] == signupID) {
-                await pathfinder.signup(uintToAddress(log.topics[1]), uintToAddress(log.data));
-            } else if (log.topics[0] == organizationSignupID) {
-                await pathfinder.organizationSignup(uintToAddress(log.topics[1]));
-            } else if (log.topics[0] == trustID) {
-                await pathfinder.trust(uintToAddress(log.topics[1]), uintToAddress(log.topics[2]), log.data - 0)
-            }
-            //hubEventContainer.innerHTML = log.blockNumber;
-            successNr += 1;
-        } catch {
-            //console.log(`Error processing log: ${log.blockNumber} - ${log.transactionIndex}`)
-            //console.log(log)
-        }
-    }
-    console.log(`Hub events processed, ${successNr} out of ${res.length} successfully.`);
+    let result = await pathfinder.applyLogs(res, hubAddress);
+    console.log(`Hub events processed, ${result.applied} out of ${res.length} applied, ${result.skipped} already known.`);
     res = await provider.getLogs({
         fromBlock: lastKnownBlock,
         topics: [ethers.utils.id("Transfer(address,address,uint256)")]
     });
     console.log("Number of transfers to process: " + res.length);
-    successNr = 0;
-    for (log of res) {
-        try {
-            let value = log.data;
-            let token = log.address;
-            let from = uintToAddress(log.topics[1]);
-            let to = uintToAddress(log.topics[2]);
-            await pathfinder.transfer(token, from, to, value)
-            //transferEventContainer.innerHTML = log.blockNumber;
-            successNr += 1;
-        } catch {
-            //console.log(`Error processing log: ${log.blockNumber} - ${log.transactionIndex}`)
-            //console.log(log)
-        }
-    }
-    console.log(`Transfers processed, ${successNr} out of ${res.length} successfully.`);
+    result = await pathfinder.applyLogs(res, hubAddress);
+    console.log(`Transfers processed, ${result.applied} out of ${res.length} applied, ${result.skipped} already known.`);
     await pathfinder.performEdgeUpdates();
     update();
     console.log("Edge count: " + await pathfinder.edgeCount());
@@ -212,22 +194,22 @@ let updateSinceBlock = async function(lastKnownBlock) {
 
 let setupEventListener = async function() {
     console.log("Block: " + await provider.getBlockNumber());
-    hubContract.on("Trust", async (sendTo, user, limitPercentage) => {
+    hubContract.on("Trust", async (sendTo, user, limitPercentage, event) => {
         console.log(`trust ${user} -> ${sendTo} (${limitPercentage}) `);
         // TODO check that limitPercentage is actually a number.
-        await pathfinder.trust(sendTo, user, limitPercentage - 0);
+        await pathfinder.trust(sendTo, user, limitPercentage - 0, logPosition(event));
         update();
         // TODO block number?
     });
-    hubContract.on("Signup", async (user, token) => {
+    hubContract.on("Signup", async (user, token, event) => {
         console.log(`signup ${user} ${token}`);
-        await pathfinder.signup(user, token);
+        await pathfinder.signup(user, token, logPosition(event));
         update();
         // TODO block number?
     });
-    hubContract.on("OrganizationSignup", async (organization) => {
+    hubContract.on("OrganizationSignup", async (organization, event) => {
         console.log(`organization signup ${organization}`);
-        await pathfinder.organizationSignup(organization);
+        await pathfinder.organizationSignup(organization, logPosition(event));
         update();
         // TODO block number?
     });
@@ -237,14 +219,23 @@ let setupEventListener = async function() {
         let from = uintToAddress(log.topics[1]);
         let to = uintToAddress(log.topics[2]);
         console.log(`Transfer ${from} -> ${to}: ${value} ${token}`);
-        await pathfinder.transfer(token, from, to, value)
+        await pathfinder.transfer(token, from, to, value, logPosition(log))
         update();
         latestBlockNumber = log.blockNumber;
     });
 };
 
 let startup = async function() {
-    latestBlockNumber = await loadDB();
+    if (stream) {
+        // Restart from the local journal if there is one, otherwise start a new one
+        // with the downloaded database.
+        latestBlockNumber = await pathfinder.openJournal('journal');
+        if (latestBlockNumber == 0) {
+            await loadDB();
+            latestBlockNumber = await pathfinder.openJournal('journal');
+        }
+    } else
+        latestBlockNumber = await loadDB();
     await updateSinceBlock(latestBlockNumber);
     await setupEventListener();
     update();
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+/// Non-owning read-only view of a contiguous range of elements
+/// (a minimal replacement for C++20's std::span).
+template <class T>
+class Span
+{
+public:
+	Span() = default;
+	Span(T const* _data, size_t _size): m_data(_data), m_size(_size) {}
+
+	T const* begin() const { return m_data; }
+	T const* end() const { return m_data + m_size; }
+	T const* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	T const& operator[](size_t _index) const { return m_data[_index]; }
+
+private:
+	T const* m_data = nullptr;
+	size_t m_size = 0;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Bit-serial versions of the Int arithmetic and digit-by-digit versions of the
+/// decimal conversion, the previous implementations.
+/// They are slow but simple, so the tests and benchmarks compare the limb-wise kernels against them.
+
+/// Shift-and-add multiplication, the previous implementation of Int::operator*.
+inline Int referenceMultiply(Int _value, uint32_t _factor)
+{
+	Int result;
+	while (_factor > 0)
+	{
+		if (_factor & 1)
+			result += _value;
+		_value = _value.timesTwo();
+		_factor >>= 1;
+	}
+	return result;
+}
+
+/// Bit-by-bit long division, the previous implementation of Int::operator/.
+inline Int referenceDivide(Int const& _value, uint32_t _divisor)
+{
+	Int quotient;
+	uint64_t remainder = 0;
+	for (size_t i = 256; i-- > 0;)
+	{
+		remainder = (remainder << 1) | ((_value.data[i / 64] >> (i % 64)) & 1);
+		if (remainder >= _divisor)
+		{
+			remainder -= _divisor;
+			quotient.data[i / 64] |= uint64_t(1) << (i % 64);
+		}
+	}
+	return quotient;
+}
+
+/// Subtraction via the two's complement, the previous implementation of Int::operator-.
+inline Int referenceSubtract(Int const& _a, Int const& _b)
+{
+	Int complement = _b;
+	for (uint64_t& limb: complement.data)
+		limb = ~limb;
+	return _a + complement + Int(1);
+}
+
+inline Int referenceTimesTen(Int const& _value)
+{
+	Int timesTwo = _value.timesTwo();
+	Int timesEight = timesTwo.timesTwo().timesTwo();
+	return timesEight + timesTwo;
+}
+
+/// Digit-by-digit parsing like the previous implementation of Int(std::string_view).
+/// That one added the digit to the lowest limb only and lost the carry, e.g. for 2^64.
+inline Int referenceParse(std::string const& _value)
+{
+	Int result;
+	for (char c: _value)
+		result = referenceTimesTen(result) + Int(static_cast<uint64_t>(c - '0'));
+	return result;
+}
+
+/// Formatting by repeated subtraction of powers of ten, the previous implementation of to_string(Int).
+inline std::string referenceFormat(Int _value)
+{
+	static std::vector<Int> powersOfTen;
+	if (powersOfTen.empty())
+		for (Int x{1}; powersOfTen.empty() || powersOfTen.back() < x; x = referenceTimesTen(x))
+			powersOfTen.push_back(x);
+
+	std::string result;
+	for (size_t i = powersOfTen.size(); i-- > 0;)
+	{
+		char digit = '0';
+		while (_value >= powersOfTen[i])
+		{
+			_value -= powersOfTen[i];
+			digit++;
+		}
+		if (digit != '0' || !result.empty())
+			result.push_back(digit);
+	}
+	return result.empty() ? "0" : result;
+}
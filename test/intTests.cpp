@@ -0,0 +1,194 @@
+#include "test/intReference.h"
+
+#include "exceptions.h"
+#include "types.h"
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+size_t failures = 0;
+
+void check(bool _condition, string const& _description)
+{
+	if (!_condition)
+	{
+		cout << "Failed: " << _description << endl;
+		failures++;
+	}
+}
+
+/// @returns an Int from its limbs, lowest first.
+Int fromLimbs(uint64_t _l0, uint64_t _l1 = 0, uint64_t _l2 = 0, uint64_t _l3 = 0)
+{
+	Int value;
+	value.data[0] = _l0;
+	value.data[1] = _l1;
+	value.data[2] = _l2;
+	value.data[3] = _l3;
+	return value;
+}
+
+/// Values that use only the lowest limb, two limbs and all four limbs, i.e. that take
+/// the 64-bit, the 128-bit and the full-width paths of the kernels.
+vector<Int> testValues()
+{
+	uint64_t const ones = uint64_t(-1);
+	vector<Int> values{
+		Int(0),
+		Int(1),
+		Int(99),
+		Int(ones),
+		fromLimbs(0, 1),
+		fromLimbs(ones, 1),
+		fromLimbs(ones, ones),
+		fromLimbs(0x123456789abcdef0, 0xfedcba9876543210),
+		fromLimbs(0, 0, 1),
+		fromLimbs(0, 0, 0, 1),
+		fromLimbs(1, 0, 0, uint64_t(1) << 63),
+		Int::max()
+	};
+	mt19937_64 random(42);
+	for (size_t limbs: {size_t(1), size_t(2), size_t(4)})
+		for (size_t i = 0; i < 100; ++i)
+		{
+			Int value;
+			for (size_t j = 0; j < limbs; ++j)
+				value.data[j] = random();
+			values.push_back(value);
+		}
+	return values;
+}
+
+void checkMultiplication(vector<Int> const& _values)
+{
+	for (Int const& value: _values)
+		for (uint32_t factor: {0u, 1u, 2u, 100u, 0x7fffffffu, 0x80000000u, 0xfffffffeu, 0xffffffffu})
+			check(value * factor == referenceMultiply(value, factor), to_string(value) + " * " + to_string(factor));
+
+	// Overflow wraps around, like the shift-and-add version.
+	check(Int::max() * 2 == Int::max() - Int(1), "max * 2");
+	check(fromLimbs(uint64_t(-1)) * 0xffffffffu == fromLimbs(0xffffffff00000001, 0xfffffffe), "(2^64 - 1) * (2^32 - 1)");
+}
+
+void checkDivision(vector<Int> const& _values)
+{
+	// Divisors close to 2^32 make the remainder use the full 32 bits of a digit.
+	for (Int const& value: _values)
+		for (uint32_t divisor: {1u, 2u, 3u, 10u, 100u, 0x7fffffffu, 0x80000000u, 0x80000001u, 0xfffffffeu, 0xffffffffu})
+			check(value / divisor == referenceDivide(value, divisor), to_string(value) + " / " + to_string(divisor));
+
+	check(Int::max() / 0xffffffffu == fromLimbs(0x0000000100000001, 0x0000000100000001, 0x0000000100000001, 0x0000000100000001), "max / (2^32 - 1)");
+	check(fromLimbs(0, 1) / 0xffffffffu == fromLimbs(0x100000001), "2^64 / (2^32 - 1)");
+	bool thrown = false;
+	try
+	{
+		Int(1) / 0;
+	}
+	catch (Exception const&)
+	{
+		thrown = true;
+	}
+	check(thrown, "division by zero throws");
+}
+
+void checkSubtraction(vector<Int> const& _values)
+{
+	for (size_t i = 0; i < _values.size(); ++i)
+	{
+		Int const& a = _values[i];
+		Int const& b = _values[_values.size() - 1 - i];
+		check(a - b == referenceSubtract(a, b), to_string(a) + " - " + to_string(b));
+		check(b - a == referenceSubtract(b, a), to_string(b) + " - " + to_string(a));
+		Int difference = a;
+		difference -= b;
+		check(difference + b == a, "(" + to_string(a) + " - " + to_string(b) + ") + b");
+	}
+
+	// Subtraction wraps around, the borrow runs through all limbs.
+	check(Int(0) - Int(1) == Int::max(), "0 - 1");
+	check(Int(1) - Int(2) == Int::max(), "1 - 2");
+	check(Int(0) - Int::max() == Int(1), "0 - max");
+	check(-Int(1) == Int::max(), "-1");
+	check(fromLimbs(0, 1) - Int(1) == fromLimbs(uint64_t(-1)), "2^64 - 1");
+	check(fromLimbs(0, 0, 0, 1) - Int(1) == fromLimbs(uint64_t(-1), uint64_t(-1), uint64_t(-1)), "2^192 - 1");
+	check(fromLimbs(5) - fromLimbs(7, 1) == fromLimbs(uint64_t(-2), uint64_t(-2), uint64_t(-1), uint64_t(-1)), "5 - (2^64 + 7)");
+}
+
+
+/// Checks that @a _decimal is parsed to @a _value and that @a _value is formatted as @a _decimal.
+void checkDecimal(string const& _decimal, Int const& _value)
+{
+	check(Int(_decimal) == _value, "parse " + _decimal);
+	check(Int(_decimal) == referenceParse(_decimal), "parse " + _decimal + " like the reference");
+	check(to_string(_value) == _decimal, "format " + _decimal);
+	check(referenceFormat(_value) == _decimal, "format " + _decimal + " like the reference");
+}
+
+void checkDecimalConversion(vector<Int> const& _values)
+{
+	// Values are converted in chunks of 19 digits, so check the chunk boundaries,
+	// values with inner chunks that are zero and the widest value.
+	checkDecimal("0", Int(0));
+	checkDecimal("9", Int(9));
+	checkDecimal("1000000000000000000", Int(1000000000000000000));
+	checkDecimal("9999999999999999999", Int(9999999999999999999u));
+	checkDecimal("10000000000000000000", Int(10000000000000000000u));
+	checkDecimal("10000000000000000001", Int(10000000000000000001u));
+	checkDecimal("18446744073709551615", Int(uint64_t(-1)));
+	checkDecimal("18446744073709551616", fromLimbs(0, 1));
+	checkDecimal("99999999999999999999999999999999999999", fromLimbs(0x098a223fffffffff, 0x4b3b4ca85a86c47a));
+	checkDecimal("100000000000000000000000000000000000000", fromLimbs(0x098a224000000000, 0x4b3b4ca85a86c47a));
+	checkDecimal("100000000000000000000000000000000000001", fromLimbs(0x098a224000000001, 0x4b3b4ca85a86c47a));
+	checkDecimal("100000000000000000010000000000000000000", fromLimbs(0x9451454489e80000, 0x4b3b4ca85a86c47a));
+	checkDecimal(
+		"115792089237316195423570985008687907853269984665640564039457584007913129639935",
+		Int::max()
+	);
+
+	// Leading zeros are allowed, also across chunk boundaries.
+	check(Int(string("0000000000000000000000000000000000000042")) == Int(42), "parse with leading zeros");
+	check(Int(string()) == Int(0), "parse empty");
+
+	for (Int const& value: _values)
+		checkDecimal(referenceFormat(value), value);
+
+	// Invalid digits throw, also in later chunks and at the last position.
+	for (string invalid: {"a", "-1", " 1", "1 ", "12a4", "1234567890123456789x", "12345678901234567890123456789012345678/", "1e5"})
+	{
+		bool thrown = false;
+		try
+		{
+			Int{invalid};
+		}
+		catch (Exception const&)
+		{
+			thrown = true;
+		}
+		check(thrown, "parse \"" + invalid + "\" throws");
+	}
+}
+
+}
+
+int main()
+{
+	vector<Int> values = testValues();
+	checkMultiplication(values);
+	checkDivision(values);
+	checkSubtraction(values);
+	checkDecimalConversion(values);
+
+	if (failures > 0)
+	{
+		cout << failures << " checks failed." << endl;
+		return 1;
+	}
+	cout << "All Int checks passed." << endl;
+	return 0;
+}
@@ -5,6 +5,12 @@ set -e
 (
 cd "$(dirname "$0")"
 
+# Checks of the Int arithmetic and decimal conversion.
+../build/pathfinder-test
+
+# journal.json and journal_order.json restore from these directories and expect them to start out empty.
+rm -rf /tmp/pathfinder_test_journal /tmp/pathfinder_test_journal_order
+
 for testfile in *
 do
     if [[ "$testfile" =~ .*_exp\.json || ! "$testfile" =~ .*\.json ]]
@@ -12,7 +18,8 @@ do
         continue
     fi
     set -e
-    ../build/pathfinder --json < "$testfile" > /tmp/output.json
+    # Without worker threads, so that the responses are in the order of the commands.
+    ../build/pathfinder --json 0 < "$testfile" > /tmp/output.json
     expfile="$testfile"_exp.json
     set +e
     if [ "$1" = "--update" ]
@@ -6,13 +6,46 @@
 
 using namespace std;
 
+namespace
+{
+/// Used for the carries of the limb-wise arithmetic.
+__extension__ typedef unsigned __int128 uint128;
+
+/// Decimal numbers are converted in chunks of this many digits, the most that fit into 64 bits.
+size_t constexpr decimalChunkDigits = 19;
+uint64_t constexpr decimalChunkBase = 10000000000000000000u;
 
-Int timesTen(Int const& _value)
+/// Sets @a _value to @a _value * @a _factor + @a _summand, wrapping around like operator+.
+void multiplyAdd(Int& _value, uint64_t _factor, uint64_t _summand)
 {
-	Int timesTwo = _value.timesTwo();
-	Int timesFour = timesTwo.timesTwo();
-	Int timesEight = timesFour.timesTwo();
-	return timesEight + timesTwo;
+	uint64_t carry = _summand;
+	for (uint64_t& limb: _value.data)
+	{
+		uint128 result = uint128(limb) * _factor + carry;
+		limb = uint64_t(result);
+		carry = uint64_t(result >> 64);
+	}
+}
+
+/// Divides @a _value by @a _divisor in place and @returns the remainder.
+uint64_t divideWithRemainder(Int& _value, uint64_t _divisor)
+{
+	uint64_t remainder = 0;
+	for (size_t i = 4; i-- > 0;)
+		if (remainder == 0)
+		{
+			// Avoid the slower 128-bit division for the leading limbs.
+			remainder = _value.data[i] % _divisor;
+			_value.data[i] /= _divisor;
+		}
+		else
+		{
+			uint128 dividend = (uint128(remainder) << 64) | _value.data[i];
+			_value.data[i] = uint64_t(dividend / _divisor);
+			remainder = uint64_t(dividend % _divisor);
+		}
+	return remainder;
+}
 }
 
 Int::Int(uint64_t _value)
@@ -32,11 +65,18 @@ Int::Int(string_view _value): Int(0)
 			data[bit / 64] |= uint64_t(fromHex(_value[i])) << (bit % 64);
 		}
 	else
-		for (char c: _value)
+		for (size_t chunkStart = 0; chunkStart < _value.size(); chunkStart += decimalChunkDigits)
 		{
-			*this = timesTen(*this);
-			require('0' <= c && c <= '9');
-			data[0] += static_cast<uint64_t>(c - '0');
+			string_view chunk = _value.substr(chunkStart, decimalChunkDigits);
+			uint64_t chunkValue = 0;
+			uint64_t scale = 1;
+			for (char c: chunk)
+			{
+				require('0' <= c && c <= '9');
+				chunkValue = chunkValue * 10 + static_cast<uint64_t>(c - '0');
+				scale *= 10;
+			}
+			multiplyAdd(*this, scale, chunkValue);
 		}
 }
 
@@ -45,24 +85,31 @@ Int& Int::operator+=(Int const& _other)
 	uint64_t carry = 0;
 	for (size_t i = 0; i < 4; i++)
 	{
-		uint64_t newCarry = 0;
-		uint64_t x = data[i] + _other.data[i];
-		if (x < data[i] || x + carry < x)
-			newCarry = 1;
-		data[i] = x + carry;
-		carry = newCarry;
+		uint128 sum = uint128(data[i]) + _other.data[i] + carry;
+		data[i] = uint64_t(sum);
+		carry = uint64_t(sum >> 64);
 	}
 	// TODO: overflow if carry is nonzero.
 	// TOOD but this clashes with subtraction.
 	return *this;
 }
 
-Int Int::operator-() const
+Int& Int::operator-=(Int const& _other)
 {
-	Int x = *this;
+	// Wraps around, like adding the two's complement.
+	uint64_t borrow = 0;
 	for (size_t i = 0; i < 4; i++)
-		x.data[i] = ~x.data[i];
-	return x + Int(1);
+	{
+		uint128 difference = uint128(data[i]) - _other.data[i] - borrow;
+		data[i] = uint64_t(difference);
+		borrow = uint64_t(difference >> 64) & 1;
+	}
+	return *this;
+}
+
+Int Int::operator-() const
+{
+	return Int{} - *this;
 }
 
 Int Int::half() const
@@ -92,13 +139,19 @@ Int Int::timesTwo() const
 Int Int::operator*(uint32_t _other) const
 {
 	Int result;
-	Int shifted = *this;
-	while (_other > 0)
+	if ((data[1] | data[2] | data[3]) == 0)
+	{
+		uint128 product = uint128(data[0]) * _other;
+		result.data[0] = uint64_t(product);
+		result.data[1] = uint64_t(product >> 64);
+		return result;
+	}
+	uint64_t carry = 0;
+	for (size_t i = 0; i < 4; i++)
 	{
-		if (_other & 1)
-			result += shifted;
-		shifted = shifted.timesTwo();
-		_other >>= 1;
+		uint128 product = uint128(data[i]) * _other + carry;
+		result.data[i] = uint64_t(product);
+		carry = uint64_t(product >> 64);
 	}
 	return result;
 }
@@ -106,20 +159,22 @@ Int Int::operator*(uint32_t _other) const
 Int Int::operator/(uint32_t _other) const
 {
 	require(_other != 0);
-	Int n = *this;
-	Int quotient{};
+	Int quotient;
+	if ((data[1] | data[2] | data[3]) == 0)
+	{
+		quotient.data[0] = data[0] / _other;
+		return quotient;
+	}
+	// Long division in 32-bit digits, starting at the highest non-zero limb.
+	// The remainder is smaller than the divisor, so the remainder together with
+	// the next digit fits into 64 bits and no 128-bit division is needed.
 	uint64_t remainder = 0;
-
-	for (int i = 255; i >= 0; i--)
+	for (size_t i = data[3] ? 4 : data[2] ? 3 : 2; i-- > 0;)
 	{
-		remainder <<= 1;
-		if (n.data[i / 64] & (uint64_t(1) << (i % 64)))
-			remainder++;
-		if (remainder >= _other)
-		{
-			remainder -= _other;
-			quotient.data[i / 64] |= uint64_t(1) << (i % 64);
-		}
+		uint64_t high = (remainder << 32) | (data[i] >> 32);
+		uint64_t low = ((high % _other) << 32) | (data[i] & 0xffffffff);
+		quotient.data[i] = ((high / _other) << 32) | (low / _other);
+		remainder = low % _other;
 	}
 	return quotient;
 }
@@ -134,35 +189,29 @@ Int Int::max()
 
 string to_string(Int _value)
 {
-	static vector<Int> powersOfTen;
-	if (powersOfTen.empty())
+	// Split off the lowest 19 digits at a time and write them from the back.
+	char buffer[80];
+	char* end = buffer + sizeof(buffer);
+	char* position = end;
+	while (true)
 	{
-		Int x{1};
-		while (true)
+		uint64_t chunk = divideWithRemainder(_value, decimalChunkBase);
+		if (_value == Int(0))
 		{
-			powersOfTen.push_back(x);
-			Int next = timesTen(x);
-			if (next < x)
-				break;
-			x = move(next);
+			do
+			{
+				*--position = char('0' + chunk % 10);
+				chunk /= 10;
+			}
+			while (chunk != 0);
+			return string(position, end);
 		}
-	}
-
-	string result;
-	for (size_t i = 0; i < powersOfTen.size(); i++)
-	{
-		Int const& pt = powersOfTen[powersOfTen.size() - i - 1];
-		size_t digit = 0;
-		while (_value >= pt)
+		for (size_t i = 0; i < decimalChunkDigits; ++i)
 		{
-			_value -= pt;
-			digit++;
+			*--position = char('0' + chunk % 10);
+			chunk /= 10;
 		}
-		if (digit != 0 || !result.empty())
-			result.push_back('0' + digit);
 	}
-	require(_value == Int(0));
-	return result.empty() ? "0" : result;
 }
 
 Address::Address(string_view _hex)
@@ -7,7 +7,8 @@
 #include <set>
 #include <iostream>
 #include <array>
-#include <variant>
+#include <functional>
+#include <cstring>
 
 
 struct Int
@@ -27,11 +28,13 @@ struct Int
 		return x;
 	}
 	Int operator-() const;
-	Int& operator-=(Int const& _other)
+	Int& operator-=(Int const& _other);
+	Int operator-(Int const& _other) const
 	{
-		return (*this) += -_other;
+		Int x = *this;
+		x -= _other;
+		return x;
 	}
-	Int operator-(Int const& _other) const { return (*this) + (-_other); }
 	Int operator*(uint32_t _other) const;
 	Int& operator*=(uint32_t _other) { return *this = *this * _other; }
 	Int operator/(uint32_t _other) const;
@@ -79,26 +82,45 @@ struct Address
 std::string to_string(Address const& _address);
 inline std::ostream& operator<<(std::ostream& os, Address const& _address) { return os << to_string(_address); }
 
+namespace std
+{
+template<> struct hash<Address>
+{
+	size_t operator()(Address const& _address) const
+	{
+		// Addresses are usually hashes already, but short ones only use the last bytes.
+		uint64_t parts[3] = {};
+		memcpy(parts, _address.address.data(), 20);
+		return size_t(parts[0] ^ (parts[1] * 0x9e3779b97f4a7c15) ^ (parts[2] * 0xc2b2ae3d27d4eb4f));
+	}
+};
+}
+
+/// Dense index of an address (safe or token) assigned by an AddressInterner.
+using NodeId = uint32_t;
+/// Id of the zero address, which every interner assigns first.
+NodeId constexpr NullNode = 0;
+
 struct Connection
 {
-	Address canSendToAddress;
-	Address userAddress;
+	NodeId canSendTo;
+	NodeId user;
 	Int limit;
 	uint32_t limitPercentage;
 
 	bool operator<(Connection const& _other) const
 	{
 		return
-			std::tie(canSendToAddress, userAddress) <
-			std::tie(_other.canSendToAddress, _other.userAddress);
+			std::tie(canSendTo, user) <
+			std::tie(_other.canSendTo, _other.user);
 	}
 };
 
 struct Edge
 {
-	Address from;
-	Address to;
-	Address token;
+	NodeId from;
+	NodeId to;
+	NodeId token;
 	Int capacity;
 
 	bool operator<(Edge const& _other) const
@@ -110,7 +132,3 @@ struct Edge
 };
 
 
-/// Node in the flow Graph.
-/// Either an actual node, or a newly introduced node on a token edge.
-using FlowGraphNode = std::variant<Address, std::tuple<Address, Address>>;
-
@@ -0,0 +1,47 @@
+#include "workerPool.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(size_t _threads)
+{
+	for (size_t i = 0; i < _threads; ++i)
+		m_threads.emplace_back([this]() { work(); });
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_jobAvailable.notify_all();
+	for (thread& worker: m_threads)
+		worker.join();
+}
+
+void WorkerPool::enqueue(function<void()> _job)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_jobs.emplace_back(move(_job));
+	}
+	m_jobAvailable.notify_one();
+}
+
+void WorkerPool::work()
+{
+	while (true)
+	{
+		function<void()> job;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [&]() { return m_stopping || !m_jobs.empty(); });
+			// Finish the remaining jobs before stopping.
+			if (m_jobs.empty())
+				return;
+			job = move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Fixed set of threads that run queued jobs in the order they were added.
+class WorkerPool
+{
+public:
+	explicit WorkerPool(size_t _threads);
+	/// Waits until all queued jobs are finished.
+	~WorkerPool();
+	WorkerPool(WorkerPool const&) = delete;
+	WorkerPool& operator=(WorkerPool const&) = delete;
+
+	/// Queues @a _job, which must not throw.
+	void enqueue(std::function<void()> _job);
+
+private:
+	void work();
+
+	std::mutex m_mutex;
+	std::condition_variable m_jobAvailable;
+	std::deque<std::function<void()>> m_jobs;
+	bool m_stopping = false;
+	std::vector<std::thread> m_threads;
+};